@@ -0,0 +1,142 @@
+// Wall time of explicit Euler steps of a CH_multi term with N = 3, 5 and 8 species, stored one field
+// per species (SoA) or interleaved on each site (AoS), with a full and a diagonal mobility matrix.
+// Arguments: grid size (default 256, 2D) and number of steps (default 100)
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <memory>
+#include <random>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "../src/core/system.hpp"
+#include "../src/ops/fd_ops.hpp"
+#include "../src/physics/fe_ch_multi_quad.hpp"
+#include "../src/physics/mobility_multi.hpp"
+#include "../src/terms/ch_term_multi.hpp"
+
+using namespace circa;
+
+namespace {
+
+constexpr double dt = 1e-3;
+constexpr double kappa = 1.0;
+
+template <int N>
+FE_CH_MultiQuad<N> free_energy() {
+    FE_CH_MultiQuad<N> fe;
+    for(int i = 0; i < N; i++) {
+        fe.a[i] = -1.0;
+        fe.b[i] = 1.0;
+        fe.kappa[i] = kappa;
+        for(int j = 0; j < N; j++) {
+            fe.chi[i][j] = (i == j) ? 0.0 : 0.2;
+        }
+    }
+    return fe;
+}
+
+template <int N>
+MobilityDiagConst<2, N> diag_mobility() {
+    MobilityDiagConst<2, N> m;
+    m.M.fill(1.0);
+    return m;
+}
+
+template <int N>
+MobilityFullConst<2, N> full_mobility() {
+    MobilityFullConst<2, N> m;
+    for(int i = 0; i < N; i++) {
+        for(int j = 0; j < N; j++) {
+            m.M[i][j] = (i == j) ? 1.0 : 0.1;
+        }
+    }
+    return m;
+}
+
+// runs the steps and returns the wall time in ms, leaving the final state in S
+template <int N, SpeciesLayout L, class MOB>
+double run(FieldStore<2>& S, const MOB& mob, int steps) {
+    static const FDOps<2> ops;
+    std::vector<std::string> names;
+    for(int s = 0; s < N; s++) {
+        names.push_back("phi" + std::to_string(s));
+    }
+    FieldStore<2> dS(S.g);
+    System<2> sys;
+    sys.add(std::make_unique<CHMultiTerm<2, N, FE_CH_MultiQuad<N>, MOB, FDOps<2>, L>>(S, dS, ops, names, free_energy<N>(), mob, kappa));
+
+    auto start = std::chrono::steady_clock::now();
+    for(int k = 0; k < steps; k++) {
+        dS.zero();
+        sys.set_state(&S, &dS);
+        sys.rhs();
+        axpy(S, dS, dt);
+    }
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+    return elapsed.count() * 1e3;
+}
+
+FieldStore<2> initial_state(const Grid<2>& g, int n_species) {
+    FieldStore<2> S(g);
+    std::mt19937 rng(42);
+    std::normal_distribution<double> gauss(0.0, 0.05);
+    for(int s = 0; s < n_species; s++) {
+        for(auto& v : S.ensure("phi" + std::to_string(s)).a) {
+            v = gauss(rng);
+        }
+    }
+    return S;
+}
+
+// largest difference between the species of two states
+double max_difference(const FieldStore<2>& a, const FieldStore<2>& b) {
+    std::unordered_map<std::string, const Field<2>*> fields;
+    a.for_each_field([&](const std::string& name, const Field<2>& f) {
+        fields[name] = &f;
+    });
+    double diff = 0.0;
+    b.for_each_field([&](const std::string& name, const Field<2>& f) {
+        const Field<2>& other = *fields.at(name);
+        for(index_t i = 0; i < f.g.size; i++) {
+            diff = std::max(diff, std::abs(double(f.a[i]) - other.a[i]));
+        }
+    });
+    return diff;
+}
+
+// prints the SoA and AoS times of one mobility and returns the largest difference between the two
+template <int N, class MOB>
+double compare(const Grid<2>& g, const MOB& mob, int steps, const char* name) {
+    FieldStore<2> soa = initial_state(g, N), aos = initial_state(g, N);
+    const double t_soa = run<N, SpeciesLayout::SoA>(soa, mob, steps);
+    const double t_aos = run<N, SpeciesLayout::AoS>(aos, mob, steps);
+    std::printf("   %s %6.0f / %6.0f", name, t_soa, t_aos);
+    return max_difference(soa, aos);
+}
+
+template <int N>
+double row(const Grid<2>& g, int steps) {
+    std::printf("N=%d", N);
+    double diff = compare<N>(g, full_mobility<N>(), steps, "full");
+    diff = std::max(diff, compare<N>(g, diag_mobility<N>(), steps, "diag"));
+    std::printf("   max |soa - aos| = %.1e\n", diff);
+    return diff;
+}
+
+}  // namespace
+
+int main(int argc, char* argv[]) {
+    const int n = (argc > 1) ? std::stoi(argv[1]) : 256;
+    const int steps = (argc > 2) ? std::stoi(argv[2]) : 100;
+    Grid<2> g({n, n}, {(double)n, (double)n});
+
+    std::printf("%dx%d grid, %d Euler steps (wall ms, soa / aos)\n", n, n, steps);
+    double diff = row<3>(g, steps);
+    diff = std::max(diff, row<5>(g, steps));
+    diff = std::max(diff, row<8>(g, steps));
+    // both layouts run the same arithmetic, up to the reassociations allowed by -ffast-math
+    return (diff < 1e-12) ? 0 : 1;
+}
@@ -0,0 +1,88 @@
+// Write and read throughput of the plain-text format for a 4096^2 field (or the size given as the
+// first argument), compared with the iostream implementation it replaced
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <iomanip>
+#include <random>
+#include <string>
+
+#include "../src/io/plain.hpp"
+
+using namespace circa;
+
+namespace {
+
+// the previous implementation: operator<< and std::endl on every row, operator>> to read back
+void write_stream(const Field<2>& f, const std::string& filename) {
+    std::ofstream os(filename);
+    const int nx = f.g.n[0], ny = f.g.n[1];
+    os << std::setprecision(16);
+    os << fmt::format("# step = {}, t = {}, size = {} {}, dx = {} {}", 0, 0.0, nx, ny, f.g.dx[0], f.g.dx[1]) << std::endl;
+    for(int j = 0; j < ny; ++j) {
+        for(int i = 0; i < nx; ++i) {
+            os << f.a[(index_t)j * nx + i];
+            if(i + 1 < nx) os << " ";
+        }
+        os << std::endl;
+    }
+    os << std::endl;
+}
+
+void read_stream(const std::string& filename, Field<2>& f) {
+    std::ifstream is(filename);
+    std::string line;
+    std::getline(is, line);
+    for(index_t i = 0; i < f.g.size; i++) {
+        is >> f.a[i];
+    }
+}
+
+double seconds(const std::function<void()>& fn) {
+    auto start = std::chrono::steady_clock::now();
+    fn();
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+    return elapsed.count();
+}
+
+}  // namespace
+
+int main(int argc, char* argv[]) {
+    const int n = (argc > 1) ? std::stoi(argv[1]) : 4096;
+    const std::string dir = (argc > 2) ? argv[2] : ".";
+    Grid<2> g({n, n}, {(double)n, (double)n});
+    Field<2> f(g), back_old(g), back_new(g);
+    std::mt19937 rng(42);
+    std::normal_distribution<double> gauss(0.0, 0.3);
+    for(auto& v : f.a) {
+        v = gauss(rng);
+    }
+
+    const std::string old_file = dir + "/bench_plain_stream.dat";
+    const std::string new_file = dir + "/bench_plain_fast.dat";
+    const double w_old = seconds([&]() { write_stream(f, old_file); });
+    const double w_new = seconds([&]() { io::write_field_to_plain<2>(f, new_file, 0, 0.0); });
+    const double r_old = seconds([&]() { read_stream(old_file, back_old); });
+    const double r_new = seconds([&]() { io::init_field_from_plain<2>(new_file, back_new); });
+
+    const double mb = std::filesystem::file_size(new_file) / 1e6;
+    bool same_file = std::filesystem::file_size(old_file) == std::filesystem::file_size(new_file);
+    if(same_file) {
+        std::ifstream a(old_file, std::ios::binary), b(new_file, std::ios::binary);
+        same_file = std::equal(std::istreambuf_iterator<char>(a), std::istreambuf_iterator<char>(), std::istreambuf_iterator<char>(b));
+    }
+    // 16 digits are not enough to round-trip every double, but both readers must round the same way
+    const bool same_values = (back_old.a == back_new.a);
+
+    std::printf("%dx%d field, %.1f MB\n", n, n, mb);
+    std::printf("write   stream %7.3f s (%7.1f MB/s)   fast %7.3f s (%7.1f MB/s)   x%.1f\n", w_old, mb / w_old, w_new, mb / w_new, w_old / w_new);
+    std::printf("read    stream %7.3f s (%7.1f MB/s)   fast %7.3f s (%7.1f MB/s)   x%.1f\n", r_old, mb / r_old, r_new, mb / r_new, r_old / r_new);
+    std::printf("identical files: %s, identical values read back: %s\n", same_file ? "yes" : "NO", same_values ? "yes" : "NO");
+
+    std::filesystem::remove(old_file);
+    std::filesystem::remove(new_file);
+    return (same_file && same_values) ? 0 : 1;
+}
@@ -0,0 +1,79 @@
+// Throughput and accuracy (in units in the last place, ULP) of the vmath kernels, for each accuracy mode
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <functional>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "../src/util/vmath.hpp"
+
+using namespace circa;
+
+namespace {
+
+using ArrayFn = std::function<void(const double*, double*, int, vmath::Accuracy)>;
+using RefFn = std::function<long double(long double)>;
+
+double ulp_error(double value, long double ref) {
+    const double r = (double)ref;
+    const double ulp = std::nextafter(std::abs(r), INFINITY) - std::abs(r);
+    return (double)(std::abs((long double)value - ref) / ulp);
+}
+
+void bench(const std::string& name, const ArrayFn& fn, const RefFn& ref, const std::vector<double>& x) {
+    const int n = (int)x.size();
+    const int repeats = 50;
+    std::vector<double> out(n);
+
+    for(auto acc : {vmath::Accuracy::EXACT, vmath::Accuracy::FAST}) {
+        fn(x.data(), out.data(), n, acc);  // warm-up
+
+        auto start = std::chrono::steady_clock::now();
+        for(int r = 0; r < repeats; r++) {
+            fn(x.data(), out.data(), n, acc);
+        }
+        std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+        const double mvals = (double)n * repeats / elapsed.count() / 1e6;
+
+        double max_ulp = 0.0, avg_ulp = 0.0;
+        for(int i = 0; i < n; i++) {
+            const double e = ulp_error(out[i], ref(x[i]));
+            max_ulp = std::max(max_ulp, e);
+            avg_ulp += e / n;
+        }
+
+        std::printf("%-6s %-6s %10.1f Mvals/s   max %10.2f ULP   mean %8.3f ULP\n", name.c_str(),
+                    (acc == vmath::Accuracy::FAST) ? "fast" : "exact", mvals, max_ulp, avg_ulp);
+    }
+}
+
+}  // namespace
+
+int main() {
+    const int n = 1 << 20;
+    std::mt19937 rng(42);
+    std::vector<double> x_exp(n), x_log(n), x_pow(n), x_sqrt(n);
+    std::uniform_real_distribution<double> u_exp(-50.0, 50.0), u_log(-14.0, 7.0), u_pow(0.0, 1.0), u_sqrt(0.0, 1e3);
+    for(int i = 0; i < n; i++) {
+        x_exp[i] = u_exp(rng);
+        x_log[i] = std::exp(u_log(rng));  // log-uniform in [1e-6, 1e3]
+        x_pow[i] = u_pow(rng) + 1e-3;
+        x_sqrt[i] = u_sqrt(rng);
+    }
+
+    std::printf("%d values per call\n", n);
+    bench("exp", [](const double* in, double* out, int n, vmath::Accuracy acc) { vmath::exp(in, out, n, acc); },
+          [](long double x) { return std::exp(x); }, x_exp);
+    bench("log", [](const double* in, double* out, int n, vmath::Accuracy acc) { vmath::log(in, out, n, acc); },
+          [](long double x) { return std::log(x); }, x_log);
+    // the exponent used by the Wertheim mobility, hidden from the optimiser (which would otherwise turn pow into products)
+    static volatile double exponent = 4.0;
+    bench("pow", [](const double* in, double* out, int n, vmath::Accuracy acc) { vmath::pow(in, exponent, out, n, acc); },
+          [](long double x) { return std::pow(x, 4.0L); }, x_pow);
+    bench("sqrt", [](const double* in, double* out, int n, vmath::Accuracy acc) { vmath::sqrt(in, out, n, acc); },
+          [](long double x) { return std::sqrt(x); }, x_sqrt);
+
+    return 0;
+}
@@ -1,24 +1,37 @@
 #pragma once
+#include <vector>
+
 #include "system.hpp"
 
 namespace circa {
 
 template <int D>
 struct Diagnostics {
-    static double total_mass(const Field<D>& f) {
-        double sum = 0.0;
-        for(double v : f.a) {
-            sum += v;
-        }
-        return sum * f.g.dV;
+    template <class T>
+    static double total_mass(const Field<D, T>& f) {
+        const T* a = f.a.data();
+        return reduce::sum(f.g.size, [a](index_t i) {
+            return double(a[i]);
+        }) * f.g.dV;
     }
     
+    // the free energy of each term of the system, 0 for the terms that have none
+    static std::vector<double> free_energies(const System<D>& sys) {
+        // the state has changed since the last time the cache was used
+        sys.cache->invalidate();
+        std::vector<double> FE(sys.terms.size(), 0.0);
+        for(std::size_t i = 0; i < sys.terms.size(); i++) {
+            if(auto e = dynamic_cast<const IEnergy<D>*>(sys.terms[i].get())) {
+                FE[i] = e->energy();
+            }
+        }
+        return FE;
+    }
+
     static double total_free_energy(const System<D>& sys) {
         double FE = 0.0;
-        for(const auto& up : sys.terms) {
-            if(auto e = dynamic_cast<const IEnergy<D>*>(up.get())) {
-                FE += e->energy();
-            }
+        for(double E : free_energies(sys)) {
+            FE += E;
         }
         return FE;
     }
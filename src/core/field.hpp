@@ -3,21 +3,33 @@
 #include <vector>
 
 #include "grid.hpp"
+#include "reduce.hpp"
 
 namespace circa {
 
-template <int D>
+// Scalar type used to store the fields. Arithmetic (and in particular every reduction) is carried
+// out in double precision regardless, so single-precision builds (CIRCA_SINGLE_PRECISION) trade the
+// accuracy of the stored state for half the memory footprint and bandwidth.
+#ifdef CIRCA_SINGLE_PRECISION
+using real = float;
+#else
+using real = double;
+#endif
+
+template <int D, class T = real>
 struct Field {
+    using value_type = T;
+
     Grid<D> g;
-    std::vector<double> a;
+    std::vector<T> a;
     Field() = default;
-    explicit Field(const Grid<D>& gg) : g(gg), a(gg.size, 0.0) {}
+    explicit Field(const Grid<D>& gg) : g(gg), a(gg.size, T(0)) {}
     
-    double& at(int i) { 
+    T& at(index_t i) { 
         return a[i]; 
     }
 
-    double at(int i) const { 
+    T at(index_t i) const { 
         return a[i]; 
     }
 
@@ -26,24 +38,28 @@ struct Field {
     }
 
     void fill(double v) { 
-        std::fill(a.begin(), a.end(), v); 
+        std::fill(a.begin(), a.end(), T(v)); 
     }
 };
 
-template <int D>
-inline double mean(const Field<D>& f) {
-    double s = 0;
-    for (double v : f.a) s += v;
+// the accumulators are double also when the storage is not (see reduce.hpp for the summation order)
+template <int D, class T>
+inline double mean(const Field<D, T>& f) {
+    const T* a = f.a.data();
+    double s = reduce::sum(f.g.size, [a](index_t i) {
+        return double(a[i]);
+    });
     return f.g.size ? s / f.g.size : 0.0;
 }
 
-template <int D>
-inline double var(const Field<D>& f) {
-    double m = mean(f), s = 0;
-    for (double v : f.a) {
-        double d = v - m;
-        s += d * d;
-    }
+template <int D, class T>
+inline double var(const Field<D, T>& f) {
+    const T* a = f.a.data();
+    const double m = mean(f);
+    double s = reduce::sum(f.g.size, [a, m](index_t i) {
+        const double d = a[i] - m;
+        return d * d;
+    });
     return f.g.size ? s / f.g.size : 0.0;
 }
 
@@ -4,66 +4,149 @@
 #include <stdexcept>
 
 #include "field.hpp"
+#include "multi_field.hpp"
 
 namespace circa {
 
-template <int D>
+template <int D, class T = real>
 struct FieldStore {
+    using field_type = Field<D, T>;
+    using multi_type = MultiField<D, T>;
+
     Grid<D> g;
-    std::unordered_map<std::string, Field<D>> map;
+    std::unordered_map<std::string, field_type> map;
+    // interleaved multi-component fields, whose components are not available through map
+    std::unordered_map<std::string, multi_type> multi;
     explicit FieldStore(const Grid<D>& gg) : g(gg) {}
 
-    Field<D>& ensure(const std::string& name) {
+    field_type& ensure(const std::string& name) {
         auto it = map.find(name);
         if(it == map.end()) {
-            it = map.emplace(name, Field<D>(g)).first;
+            it = map.emplace(name, field_type(g)).first;
         }
         return it->second;
     }
 
-    const Field<D>& get(const std::string& name) const {
+    const field_type& get(const std::string& name) const {
         auto it = map.find(name);
-        if(it == map.end()) throw std::runtime_error("Missing field: " + name);
+        if(it == map.end()) {
+            for(const auto& kv : multi) {
+                if(kv.second.index_of(name) >= 0) {
+                    throw std::runtime_error("Field '" + name + "' is stored interleaved in '" + kv.first + "' and cannot be accessed on its own");
+                }
+            }
+            throw std::runtime_error("Missing field: " + name);
+        }
         return it->second;
     }
 
-    const Field<D>* maybe(const std::string& name) const {
+    const field_type* maybe(const std::string& name) const {
         auto it = map.find(name);
         return it == map.end() ? nullptr : &it->second;
     }
+
+    multi_type& ensure_multi(const std::string& name, const std::vector<std::string>& comps) {
+        auto it = multi.find(name);
+        if(it == multi.end()) {
+            it = multi.emplace(name, multi_type(g, comps)).first;
+        }
+        return it->second;
+    }
+
+    const multi_type& get_multi(const std::string& name) const {
+        auto it = multi.find(name);
+        if(it == multi.end()) throw std::runtime_error("Missing multi-component field: " + name);
+        return it->second;
+    }
+
+    // Move the given fields into a single interleaved field (no-op if this has already been done)
+    multi_type& pack(const std::string& name, const std::vector<std::string>& comps) {
+        auto it = multi.find(name);
+        if(it != multi.end()) {
+            return it->second;
+        }
+        multi_type mf(g, comps);
+        for(int s = 0; s < (int)comps.size(); s++) {
+            mf.pack(s, get(comps[s]));
+        }
+        for(const auto& c : comps) {
+            map.erase(c);
+        }
+        return multi.emplace(name, std::move(mf)).first->second;
+    }
+
+    // Call fn(name, field) on every field, unpacking the components of interleaved fields into
+    // temporaries. Meant for output and diagnostics.
+    template <class F>
+    void for_each_field(F&& fn) const {
+        for(const auto& kv : map) {
+            fn(kv.first, kv.second);
+        }
+        for(const auto& kv : multi) {
+            for(int s = 0; s < kv.second.ncomp; s++) {
+                fn(kv.second.names[s], kv.second.unpack(s));
+            }
+        }
+    }
     
     void zero() {
         for(auto& kv : map) {
             kv.second.fill(0.0);
         }
+        for(auto& kv : multi) {
+            kv.second.fill(0.0);
+        }
     }
 };
 
-template <int D>
-inline void axpy(Field<D>& y, const Field<D>& x, double a) {
-    for(int i = 0; i < y.g.size; ++i) {
+template <int D, class T>
+inline void axpy(Field<D, T>& y, const Field<D, T>& x, double a) {
+    for(index_t i = 0; i < y.g.size; ++i) {
         y.a[i] += a * x.a[i];
     }
 }
 
-template <int D>
-inline void axpy(FieldStore<D>& y, const FieldStore<D>& x, double a) {
+template <int D, class T>
+inline void axpy(MultiField<D, T>& y, const MultiField<D, T>& x, double a) {
+    for(size_t i = 0; i < y.a.size(); ++i) {
+        y.a[i] += a * x.a[i];
+    }
+}
+
+template <int D, class T>
+inline void axpy(FieldStore<D, T>& y, const FieldStore<D, T>& x, double a) {
     for(const auto& kv : x.map) {
         auto& yf = y.ensure(kv.first);
-        if(yf.empty()) yf = Field<D>(y.g);
+        if(yf.empty()) yf = Field<D, T>(y.g);
         axpy(yf, kv.second, a);
     }
+    for(const auto& kv : x.multi) {
+        axpy(y.ensure_multi(kv.first, kv.second.names), kv.second, a);
+    }
 }
 
-template <int D>
-inline FieldStore<D> plus_scaled(const FieldStore<D>& X, const FieldStore<D>& Y, double aX, double aY) {
-    FieldStore<D> Z(X.g);
+template <int D, class T>
+inline FieldStore<D, T> plus_scaled(const FieldStore<D, T>& X, const FieldStore<D, T>& Y, double aX, double aY) {
+    FieldStore<D, T> Z(X.g);
     for(const auto& kv : X.map) Z.ensure(kv.first);
     for(const auto& kv : Y.map) Z.ensure(kv.first);
     for(auto& kv : Z.map) {
-        const Field<D>* xf = X.maybe(kv.first);
-        const Field<D>* yf = Y.maybe(kv.first);
-        for(int i = 0; i < Z.g.size; ++i) {
+        const Field<D, T>* xf = X.maybe(kv.first);
+        const Field<D, T>* yf = Y.maybe(kv.first);
+        for(index_t i = 0; i < Z.g.size; ++i) {
+            double xv = xf ? xf->a[i] : 0.0;
+            double yv = yf ? yf->a[i] : 0.0;
+            kv.second.a[i] = aX * xv + aY * yv;
+        }
+    }
+    for(const auto& kv : X.multi) Z.ensure_multi(kv.first, kv.second.names);
+    for(const auto& kv : Y.multi) Z.ensure_multi(kv.first, kv.second.names);
+    for(auto& kv : Z.multi) {
+        auto xit = X.multi.find(kv.first);
+        auto yit = Y.multi.find(kv.first);
+        const MultiField<D, T>* xf = (xit == X.multi.end()) ? nullptr : &xit->second;
+        const MultiField<D, T>* yf = (yit == Y.multi.end()) ? nullptr : &yit->second;
+        for(size_t i = 0; i < kv.second.a.size(); ++i) {
             double xv = xf ? xf->a[i] : 0.0;
             double yv = yf ? yf->a[i] : 0.0;
             kv.second.a[i] = aX * xv + aY * yv;
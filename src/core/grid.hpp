@@ -1,15 +1,24 @@
 #pragma once
 #include <array>
+#include <cstdint>
 
 namespace circa {
 
+// Type used for the linear indices of the grid points. It is 64-bit by default so that grids with
+// more than 2^31 points can be simulated. Define CIRCA_INDEX_32 to go back to 32-bit indices.
+#ifdef CIRCA_INDEX_32
+using index_t = std::int32_t;
+#else
+using index_t = std::int64_t;
+#endif
+
 template <int D>
 struct Grid {
     std::array<int, D> n{};
     std::array<double, D> L{};
     std::array<double, D> dx{};
     double dV;
-    int size = 0;
+    index_t size = 0;
 
     Grid() = default;
     Grid(const std::array<int, D>& n_, const std::array<double, D>& L_) : n(n_), L(L_) {
@@ -24,8 +33,8 @@ struct Grid {
 };
 
 template <int D>
-inline int flat(const std::array<int, D>& I, const std::array<int, D>& n) {
-    int s = 0, m = 1;
+inline index_t flat(const std::array<int, D>& I, const std::array<int, D>& n) {
+    index_t s = 0, m = 1;
     for (int d = 0; d < D; ++d) {
         s += I[d] * m;
         m *= n[d];
@@ -33,10 +42,10 @@ inline int flat(const std::array<int, D>& I, const std::array<int, D>& n) {
     return s;
 }
 template <int D>
-inline std::array<int, D> unflat(int lin, const std::array<int, D>& n) {
+inline std::array<int, D> unflat(index_t lin, const std::array<int, D>& n) {
     std::array<int, D> I{};
     for (int d = 0; d < D; ++d) {
-        I[d] = lin % n[d];
+        I[d] = (int)(lin % n[d]);
         lin /= n[d];
     }
     return I;
@@ -0,0 +1,87 @@
+#pragma once
+#include <algorithm>
+#include <array>
+#include <string>
+#include <vector>
+
+#include "field.hpp"
+
+namespace circa {
+
+// How the N species handled by a multi-component term are laid out in memory:
+//   SoA: one Field per species (the default)
+//   AoS: a single MultiField whose values are interleaved, a[site * N + species], so that all
+//        the species living on the same site share a cache line
+enum class SpeciesLayout { SoA, AoS };
+
+template <int D, class T = real>
+struct MultiField {
+    Grid<D> g;
+    int ncomp = 0;
+    std::vector<std::string> names;  // component names (may be empty for temporaries)
+    std::vector<T> a;
+
+    MultiField() = default;
+    MultiField(const Grid<D>& gg, int n) : g(gg), ncomp(n), a((size_t)gg.size * n, T(0)) {}
+    MultiField(const Grid<D>& gg, std::vector<std::string> nm) : MultiField(gg, (int)nm.size()) {
+        names = std::move(nm);
+    }
+
+    T& at(int s, index_t i) {
+        return a[(size_t)i * ncomp + s];
+    }
+
+    T at(int s, index_t i) const {
+        return a[(size_t)i * ncomp + s];
+    }
+
+    bool empty() const {
+        return a.empty();
+    }
+
+    void fill(double v) {
+        std::fill(a.begin(), a.end(), T(v));
+    }
+
+    int index_of(const std::string& name) const {
+        auto it = std::find(names.begin(), names.end(), name);
+        return it == names.end() ? -1 : (int)(it - names.begin());
+    }
+
+    // conversion from/to plain fields, to be used at the I/O boundaries
+    void pack(int s, const Field<D, T>& f) {
+        for(index_t i = 0; i < g.size; i++) {
+            at(s, i) = f.a[i];
+        }
+    }
+
+    Field<D, T> unpack(int s) const {
+        Field<D, T> f(g);
+        for(index_t i = 0; i < g.size; i++) {
+            f.a[i] = at(s, i);
+        }
+        return f;
+    }
+};
+
+// Uniform (species, site) access to N species stored with either layout. T is real or const real
+template <int N, SpeciesLayout L, class T = real>
+struct SpeciesView;
+
+template <int N, class T>
+struct SpeciesView<N, SpeciesLayout::SoA, T> {
+    std::array<T*, N> p;
+    T& operator()(int s, index_t i) const {
+        return p[s][i];
+    }
+};
+
+template <int N, class T>
+struct SpeciesView<N, SpeciesLayout::AoS, T> {
+    T* p;
+    T& operator()(int s, index_t i) const {
+        return p[(size_t)i * N + s];
+    }
+};
+
+}  // namespace circa
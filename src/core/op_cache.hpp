@@ -0,0 +1,92 @@
+#pragma once
+#include <array>
+#include <cstdint>
+#include <vector>
+
+#include "../ops/deriv_ops.hpp"
+#include "field.hpp"
+
+namespace circa {
+
+// Derivatives of the state fields, shared by the terms of a System so that a derivative needed by
+// several terms (or by add_rhs and energy) is computed once per stage. Entries are keyed on the
+// field's storage, the operator instance and the kind of derivative, and are valid only for the
+// version of the state they have been computed on: the System starts a new version at each RHS
+// evaluation, and whoever changes the state outside of it must call invalidate(). The buffers of
+// stale entries are recycled, so that the memory footprint does not grow with the number of stages
+template <int D>
+struct OpCache {
+    const Field<D>& laplacian(const DerivOps<D>& ops, const Field<D>& f) {
+        Entry& e = lookup(ops, f, Op::LAPLACIAN);
+        if(e.version != version) {
+            resize(e.value[0], f.g);
+            ops.laplacian(f, e.value[0]);
+            e.version = version;
+        }
+        return e.value[0];
+    }
+
+    const std::array<Field<D>, D>& gradient(const DerivOps<D>& ops, const Field<D>& f) {
+        Entry& e = lookup(ops, f, Op::GRADIENT);
+        if(e.version != version) {
+            for(auto& c : e.value) {
+                resize(c, f.g);
+            }
+            ops.gradient(f, e.value);
+            e.version = version;
+        }
+        return e.value;
+    }
+
+    // The state has changed: all the entries are stale
+    void invalidate() {
+        version++;
+    }
+
+   private:
+    enum class Op { LAPLACIAN, GRADIENT };
+
+    struct Entry {
+        const void* field = nullptr;
+        const void* ops = nullptr;
+        Op op = Op::LAPLACIAN;
+        std::uint64_t version = 0;  // 0 = never computed
+        std::array<Field<D>, D> value;
+    };
+
+    std::vector<Entry> entries;
+    std::uint64_t version = 1;
+
+    // the entry for (f, ops, op), or a stale entry of the same kind that can be reused for it
+    Entry& lookup(const DerivOps<D>& ops, const Field<D>& f, Op op) {
+        Entry* spare = nullptr;
+        for(auto& e : entries) {
+            if(e.op != op) continue;
+            if(e.field == f.a.data() && e.ops == &ops) {
+                return e;
+            }
+            if(e.version != version && spare == nullptr) {
+                spare = &e;
+            }
+        }
+        if(spare == nullptr) {
+            spare = &entries.emplace_back();
+        }
+        spare->field = f.a.data();
+        spare->ops = &ops;
+        spare->op = op;
+        spare->version = 0;
+        return *spare;
+    }
+
+    static void resize(Field<D>& f, const Grid<D>& g) {
+        if((index_t)f.a.size() != g.size) {
+            f = Field<D>(g);
+        }
+        else {
+            f.g = g;
+        }
+    }
+};
+
+}  // namespace circa
@@ -0,0 +1,61 @@
+#pragma once
+#include <algorithm>
+#include <vector>
+
+#include "grid.hpp"
+
+namespace circa::reduce {
+
+// Sums over the grid. The terms are split into blocks of a fixed size, which are summed pairwise
+// (in parallel, if OpenMP is enabled), and the partial sums of the blocks are then combined
+// pairwise. The order of the operations depends only on the number of terms, so that results are
+// bitwise reproducible regardless of the number of threads, and the rounding error grows as
+// O(log n) rather than O(n). Kahan summation is not an option, since -ffast-math optimises the
+// compensation away
+constexpr index_t block = 4096;
+
+namespace detail {
+// below this size pairs are not worth it: the loop is left to the vectoriser
+constexpr index_t leaf = 64;
+
+template <class F>
+double pairwise(index_t begin, index_t end, const F& f) {
+    if(end - begin <= leaf) {
+        double s = 0.0;
+        for(index_t i = begin; i < end; i++) {
+            s += f(i);
+        }
+        return s;
+    }
+    const index_t mid = begin + (end - begin) / 2;
+    return pairwise(begin, mid, f) + pairwise(mid, end, f);
+}
+}  // namespace detail
+
+// Sum of f(i) for i in [begin, end), where [begin, end) is (part of) a single block. Callers that
+// traverse the grid block by block themselves can collect these and pass them to combine(), which
+// gives the same result as sum()
+template <class F>
+double block_sum(index_t begin, index_t end, const F& f) {
+    return detail::pairwise(begin, end, f);
+}
+
+inline double combine(const std::vector<double>& partials) {
+    return detail::pairwise(0, (index_t)partials.size(), [&](index_t k) {
+        return partials[k];
+    });
+}
+
+// Sum of f(i) for i in [0, n). f may be called concurrently from several threads
+template <class F>
+double sum(index_t n, const F& f) {
+    const index_t nb = (n + block - 1) / block;
+    std::vector<double> partials(nb);
+#pragma omp parallel for schedule(static)
+    for(index_t k = 0; k < nb; k++) {
+        partials[k] = block_sum(k * block, std::min(n, (k + 1) * block), f);
+    }
+    return combine(partials);
+}
+
+}  // namespace circa::reduce
@@ -1,17 +1,51 @@
 #pragma once
+#include <algorithm>
+#include <chrono>
 #include <memory>
+#include <string>
 #include <vector>
 #include <functional>
 
 #include "../core/field_store.hpp"
+#include "../core/op_cache.hpp"
+#include "../core/workspace.hpp"
 
 namespace circa {
 
+// STENCIL terms combine values from neighbouring sites, POINTWISE terms update each site using only
+// values at that site, so that they can be run on any subset of the grid (see System::fuse)
+enum class TermKind { STENCIL, POINTWISE };
+
 template <int D>
 struct ITerm {
+    std::string id;  // name used in the diagnostics (the id given in the configuration)
+
     virtual ~ITerm() = default;
     virtual void add_rhs() = 0;
     virtual void set_state(FieldStore<D>* S_in, FieldStore<D>* dSdt_out) = 0;
+    // Terms that need temporaries should keep the pointer and borrow from it in add_rhs()
+    virtual void set_workspace(Workspace<D>* /*ws*/) {}
+    // Terms that take derivatives of the state should keep the pointer and take them from the cache
+    virtual void set_op_cache(OpCache<D>* /*cache*/) {}
+    // How many grid points away (along any direction) the RHS of a site can look, or -1 if the term
+    // is not local (or does not say). Used to decide whether the grid can be integrated in tiles
+    virtual int halo() const {
+        return -1;
+    }
+
+    virtual TermKind kind() const {
+        return TermKind::STENCIL;
+    }
+    // POINTWISE terms only: look up the fields used by add_rhs_range(), which adds the contribution
+    // of the sites [begin, end). add_rhs() should be equivalent to calling both on the whole grid
+    virtual void prepare_pointwise() {}
+    virtual void add_rhs_range(index_t /*begin*/, index_t /*end*/) {}
+    // STENCIL terms only: take over the evaluation of a POINTWISE term, which should then be run
+    // (through prepare_pointwise() and add_rhs_range()) within the term's own sweeps over the grid.
+    // Returns false if the term cannot do that
+    virtual bool fuse(ITerm<D>* /*pointwise*/) {
+        return false;
+    }
 };
 
 template <int D>
@@ -19,18 +53,112 @@ struct IEnergy {
     virtual ~IEnergy() = default;
     // Return total free-energy contribution (integrated over space)
     virtual double energy() const = 0;
+    // Terms that can compute their energy as a by-product of add_rhs() return true here. Once
+    // record_energy() has been called they do so during the next add_rhs() only, and make the result
+    // available through recorded_energy()
+    virtual bool records_energy() const {
+        return false;
+    }
+    virtual void record_energy() {}
+    virtual double recorded_energy() const {
+        return 0.0;
+    }
 };
 
 template <int D>
 struct System {
     std::vector<std::unique_ptr<ITerm<D>>> terms;
-    void add(std::unique_ptr<ITerm<D>> t) { terms.emplace_back(std::move(t)); }
+    // heap-allocated so that the pointers held by the terms survive moves of the System
+    std::unique_ptr<Workspace<D>> ws = std::make_unique<Workspace<D>>();
+    std::unique_ptr<OpCache<D>> cache = std::make_unique<OpCache<D>>();
+    // fused[i] is true if terms[i] is evaluated by another term (filled in by fuse())
+    std::vector<bool> fused;
+    // wall time spent by each term in add_rhs(), in seconds. The time taken by fused terms is included
+    // in that of the terms that evaluate them
+    std::vector<double> seconds;
+
+    void add(std::unique_ptr<ITerm<D>> t) {
+        t->set_workspace(ws.get());
+        t->set_op_cache(cache.get());
+        terms.emplace_back(std::move(t));
+        fused.clear();
+    }
     void rhs() {
-        for (auto& t : terms) t->add_rhs();
+        if(fused.size() != terms.size()) {
+            fuse();
+        }
+        // each evaluation is done on a new state (a new stage)
+        cache->invalidate();
+        // temporaries are released after each term, so that terms can share the same buffers
+        seconds.resize(terms.size(), 0.0);
+        for(std::size_t i = 0; i < terms.size(); i++) {
+            if(!fused[i]) {
+                auto start = std::chrono::steady_clock::now();
+                ws->reset();
+                terms[i]->add_rhs();
+                std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+                seconds[i] += elapsed.count();
+            }
+        }
+    }
+    // Hand each POINTWISE term over to the closest STENCIL term that precedes it (or, failing that,
+    // follows it) with only POINTWISE terms in between, so that its sites are updated in the same
+    // sweep rather than in a sweep of their own
+    void fuse() {
+        fused.assign(terms.size(), false);
+        const int n = terms.size();
+        auto host = [&](int i, int step) -> ITerm<D>* {
+            for(int j = i + step; j >= 0 && j < n; j += step) {
+                if(terms[j]->kind() == TermKind::STENCIL) {
+                    return terms[j].get();
+                }
+            }
+            return nullptr;
+        };
+        for(int i = 0; i < n; i++) {
+            if(terms[i]->kind() != TermKind::POINTWISE) continue;
+            for(int step : {-1, 1}) {
+                ITerm<D>* h = host(i, step);
+                if(h && h->fuse(terms[i].get())) {
+                    fused[i] = true;
+                    break;
+                }
+            }
+        }
     }
     void set_state(FieldStore<D>* S_in, FieldStore<D>* dSdt_out) {
         for (auto& t : terms) t->set_state(S_in, dSdt_out);
     }
+    // Have the terms compute the total energy of the state passed to the next rhs() call while they
+    // evaluate it. Returns false, and requests nothing, if some of the terms cannot do that
+    bool request_energy() {
+        for(auto& t : terms) {
+            auto e = dynamic_cast<IEnergy<D>*>(t.get());
+            if(e && !e->records_energy()) return false;
+        }
+        for(auto& t : terms) {
+            if(auto e = dynamic_cast<IEnergy<D>*>(t.get())) e->record_energy();
+        }
+        return true;
+    }
+    // the energy of each term (0 for terms without one) computed during the rhs() call that followed
+    // request_energy()
+    std::vector<double> recorded_energies() const {
+        std::vector<double> E(terms.size(), 0.0);
+        for(std::size_t i = 0; i < terms.size(); i++) {
+            if(auto e = dynamic_cast<const IEnergy<D>*>(terms[i].get())) E[i] = e->recorded_energy();
+        }
+        return E;
+    }
+    // largest halo of the terms, or -1 if any of them is not local
+    int halo() const {
+        int h = 0;
+        for (const auto& t : terms) {
+            if(t->halo() < 0) return -1;
+            h = std::max(h, t->halo());
+        }
+        return h;
+    }
 };
 
 template <int D>
@@ -0,0 +1,87 @@
+#pragma once
+#include <array>
+#include <stdexcept>
+#include <string>
+#include <unordered_map>
+
+#include "field.hpp"
+#include "multi_field.hpp"
+
+namespace circa {
+
+// Scratch arena that terms borrow named temporaries from. Buffers are kept alive across RHS
+// evaluations, so that repeated evaluations do not go through malloc/free and do not touch
+// fresh pages. The content of a borrowed buffer is unspecified: callers must overwrite it.
+// A name can be borrowed only once between two calls to reset().
+template <int D>
+struct Workspace {
+    Field<D>& borrow(const std::string& name, const Grid<D>& g) {
+        auto& slot = fields[name];
+        mark_in_use(slot.in_use, name);
+        resize(slot.value, g);
+        return slot.value;
+    }
+
+    std::array<Field<D>, D>& borrow_vector(const std::string& name, const Grid<D>& g) {
+        auto& slot = vectors[name];
+        mark_in_use(slot.in_use, name);
+        for(auto& f : slot.value) {
+            resize(f, g);
+        }
+        return slot.value;
+    }
+
+    MultiField<D>& borrow_multi(const std::string& name, const Grid<D>& g, int ncomp) {
+        auto& slot = multis[name];
+        mark_in_use(slot.in_use, name);
+        if(slot.value.ncomp != ncomp || (index_t)slot.value.a.size() != g.size * ncomp) {
+            slot.value = MultiField<D>(g, ncomp);
+        }
+        else {
+            slot.value.g = g;
+        }
+        return slot.value;
+    }
+
+    // Give back all the borrowed buffers (but keep their memory around)
+    void reset() {
+        for(auto& kv : fields) {
+            kv.second.in_use = false;
+        }
+        for(auto& kv : vectors) {
+            kv.second.in_use = false;
+        }
+        for(auto& kv : multis) {
+            kv.second.in_use = false;
+        }
+    }
+
+   private:
+    template <class T>
+    struct Slot {
+        T value;
+        bool in_use = false;
+    };
+
+    std::unordered_map<std::string, Slot<Field<D>>> fields;
+    std::unordered_map<std::string, Slot<std::array<Field<D>, D>>> vectors;
+    std::unordered_map<std::string, Slot<MultiField<D>>> multis;
+
+    static void mark_in_use(bool& in_use, const std::string& name) {
+        if(in_use) {
+            throw std::runtime_error("Workspace buffer '" + name + "' is already in use");
+        }
+        in_use = true;
+    }
+
+    static void resize(Field<D>& f, const Grid<D>& g) {
+        if((index_t)f.a.size() != g.size) {
+            f = Field<D>(g);
+        }
+        else {
+            f.g = g;
+        }
+    }
+};
+
+}  // namespace circa
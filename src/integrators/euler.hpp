@@ -1,12 +1,27 @@
 #pragma once
+#include <algorithm>
+#include <memory>
+
 #include "integrator.hpp"
+#include "../io/log.hpp"
 #include "../util/config.hpp"
 
 namespace circa {
 
+// Explicit Euler. If time_block > 1 (and all the terms are local) several steps are advanced at
+// once with temporal blocking: the grid is split into tiles of time_tile planes along the slowest
+// axis, and each tile is loaded together with a halo that is wide enough (time_block times the
+// halo of the terms) to advance it by time_block steps before writing it back. Each block of steps
+// thus streams the grid through memory only once, at the price of some redundant work on the halos.
+// Results are the same as with plain Euler.
 template <int D>
 struct Euler : public IIntegrator<D> {
-    explicit Euler(const BuildSysFn<D>& build, FieldStore<D>& S0, const cfg::GeneralConfig<D> &config) : IIntegrator<D>(build, S0) {}
+    explicit Euler(const BuildSysFn<D>& build, FieldStore<D>& S0, const cfg::GeneralConfig<D> &config) : IIntegrator<D>(build, S0) {
+        block = config.integrator.time_block;
+        if(block > 1) {
+            setup_blocking(build, S0, config.integrator.time_tile);
+        }
+    }
 
     void step(FieldStore<D>& S, double dt) override {
         FieldStore<D> k1(S.g);
@@ -16,6 +31,117 @@ struct Euler : public IIntegrator<D> {
 
         axpy(S, k1, dt);
     }
+
+    // with temporal blocking the first stage is evaluated tile by tile, halos included
+    bool request_energy() override {
+        return block < 2 && IIntegrator<D>::request_energy();
+    }
+
+    std::vector<double> term_seconds() const override {
+        return (block < 2) ? IIntegrator<D>::term_seconds() : local_sys.seconds;
+    }
+
+    void advance(FieldStore<D>& S, double dt, int64_t nsteps) override {
+        if(block < 2) {
+            IIntegrator<D>::advance(S, dt, nsteps);
+            return;
+        }
+        while(nsteps > 0) {
+            const int b = (int)std::min<int64_t>(block, nsteps);
+            advance_tiles(S, dt, b);
+            nsteps -= b;
+        }
+    }
+
+   private:
+    int block = 1;
+    int tile = 0;       // tile thickness, in planes along the slowest axis
+    int halo = 0;       // planes loaded on each side of a tile
+    index_t plane = 0;  // number of sites in a plane
+    // state and RHS of the current tile (halo included), and the system that works on them
+    std::unique_ptr<FieldStore<D>> S_loc, k_loc;
+    System<D> local_sys;
+    // receives the tiles once they have been advanced
+    std::unique_ptr<FieldStore<D>> next;
+
+    void setup_blocking(const BuildSysFn<D>& build, const FieldStore<D>& S0, int time_tile) {
+        const int h = this->sys_.halo();
+        if(h < 0) {
+            CIRCA_WARN("Temporal blocking requires terms that are local in space, falling back to plain Euler");
+            block = 1;
+            return;
+        }
+
+        const int n_last = S0.g.n[D - 1];
+        // tiles should cover the grid exactly, so that all the tiles have the same size
+        tile = std::min(time_tile, n_last);
+        while(n_last % tile != 0) {
+            tile--;
+        }
+        halo = block * h;
+        plane = S0.g.size / n_last;
+
+        std::array<int, D> n = S0.g.n;
+        n[D - 1] = tile + 2 * halo;
+        std::array<double, D> L = S0.g.L;
+        L[D - 1] = n[D - 1] * S0.g.dx[D - 1];
+        Grid<D> g(n, L);
+        // make sure that the spacing is exactly the same
+        g.dx = S0.g.dx;
+        g.dV = S0.g.dV;
+
+        S_loc = std::make_unique<FieldStore<D>>(g);
+        k_loc = std::make_unique<FieldStore<D>>(g);
+        for(const auto& kv : S0.map) {
+            S_loc->ensure(kv.first);
+        }
+        for(const auto& kv : S0.multi) {
+            S_loc->ensure_multi(kv.first, kv.second.names);
+        }
+        local_sys = build(*S_loc, *k_loc);
+        local_sys.set_state(S_loc.get(), k_loc.get());
+
+        CIRCA_INFO("Temporal blocking: {} steps per tile, tiles of {} planes with halos of {} planes", block, tile, halo);
+    }
+
+    // copy the plane src_p of src into the plane dst_p of dst
+    void copy_plane(const FieldStore<D>& src, int src_p, FieldStore<D>& dst, int dst_p) const {
+        for(const auto& kv : src.map) {
+            auto& f = dst.ensure(kv.first);
+            std::copy_n(kv.second.a.data() + src_p * plane, plane, f.a.data() + dst_p * plane);
+        }
+        for(const auto& kv : src.multi) {
+            auto& f = dst.ensure_multi(kv.first, kv.second.names);
+            const index_t len = plane * kv.second.ncomp;
+            std::copy_n(kv.second.a.data() + src_p * len, len, f.a.data() + dst_p * len);
+        }
+    }
+
+    void advance_tiles(FieldStore<D>& S, double dt, int nsteps) {
+        if(!next) {
+            next = std::make_unique<FieldStore<D>>(S.g);
+        }
+        const int n_last = S.g.n[D - 1];
+        const int n_loc = tile + 2 * halo;
+        for(int t0 = 0; t0 < n_last; t0 += tile) {
+            // load the tile and its halo (with periodic wrap)
+            for(int p = 0; p < n_loc; p++) {
+                const int src = ((t0 - halo + p) % n_last + n_last) % n_last;
+                copy_plane(S, src, *S_loc, p);
+            }
+            // each step invalidates this->sys_.halo() planes on each side
+            for(int k = 0; k < nsteps; k++) {
+                k_loc->zero();
+                local_sys.rhs();
+                axpy(*S_loc, *k_loc, dt);
+            }
+            for(int p = 0; p < tile; p++) {
+                copy_plane(*S_loc, halo + p, *next, t0 + p);
+            }
+        }
+        std::swap(S.map, next->map);
+        std::swap(S.multi, next->multi);
+    }
 };
 
 }  // namespace circa
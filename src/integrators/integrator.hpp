@@ -1,5 +1,6 @@
 #pragma once
 #include <functional>
+#include <vector>
 
 #include "../core/system.hpp"
 
@@ -17,6 +18,29 @@ struct IIntegrator {
 
     virtual ~IIntegrator() = default;
     virtual void step(FieldStore<D>& S, double dt) = 0;
+
+    // Compute the free energy of the current state during the first stage of the next step (where it
+    // comes almost for free), to be read with recorded_energy() afterwards. Returns false if this
+    // integrator or its terms cannot do that
+    virtual bool request_energy() {
+        return sys_.request_energy();
+    }
+
+    std::vector<double> recorded_energies() const {
+        return sys_.recorded_energies();
+    }
+
+    // wall time spent in each term so far (see System::seconds)
+    virtual std::vector<double> term_seconds() const {
+        return sys_.seconds;
+    }
+
+    // Advance by nsteps time steps. Integrators that can work on several steps at once override this
+    virtual void advance(FieldStore<D>& S, double dt, int64_t nsteps) {
+        for(int64_t k = 0; k < nsteps; k++) {
+            step(S, dt);
+        }
+    }
 };
 
 }  // namespace circa
@@ -0,0 +1,176 @@
+#pragma once
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "../core/field_store.hpp"
+
+namespace circa::io {
+
+// Runs output jobs on a background thread, so that the time loop does not wait for files to be
+// formatted and written. Each job works on its own snapshot of the state, taken when it is submitted.
+// At most max_pending jobs can be waiting: submit() blocks when the queue is full, which bounds the
+// memory used by the snapshots to max_pending + 1 copies of the state (the one being written
+// included). Snapshot buffers are recycled. Jobs run in submission order. If max_pending is 0 the
+// jobs are run synchronously by submit() instead, on the state itself.
+// Jobs that do not need the state, such as those writing small extracts of it, are queued by post().
+// Exceptions thrown by a job are rethrown by the next call to submit(), post() or flush().
+template <int D>
+class AsyncWriter {
+   public:
+    using Job = std::function<void(const FieldStore<D>&)>;
+
+    explicit AsyncWriter(std::size_t max_pending) : max_pending(max_pending) {
+        if(max_pending > 0) {
+            worker = std::thread([this]() {
+                run();
+            });
+        }
+    }
+
+    ~AsyncWriter() {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stop = true;
+        }
+        cv_jobs.notify_all();
+        if(worker.joinable()) {
+            worker.join();
+        }
+    }
+
+    AsyncWriter(const AsyncWriter&) = delete;
+    AsyncWriter& operator=(const AsyncWriter&) = delete;
+
+    void submit(const FieldStore<D>& S, Job job) {
+        if(max_pending == 0) {
+            job(S);
+            return;
+        }
+
+        std::unique_ptr<FieldStore<D>> snapshot;
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            cv_space.wait(lock, [this]() {
+                return queue.size() < max_pending || error;
+            });
+            rethrow();
+            if(!spare.empty()) {
+                snapshot = std::move(spare.back());
+                spare.pop_back();
+            }
+        }
+        // the copy is made outside of the lock, while the worker keeps writing
+        if(snapshot) {
+            *snapshot = S;
+        }
+        else {
+            snapshot = std::make_unique<FieldStore<D>>(S);
+        }
+
+        const FieldStore<D>* state = snapshot.get();
+        enqueue(std::move(snapshot), [state, job = std::move(job)]() {
+            job(*state);
+        });
+    }
+
+    // Queue a job that works on data it owns rather than on the state
+    void post(std::function<void()> job) {
+        if(max_pending == 0) {
+            job();
+            return;
+        }
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            cv_space.wait(lock, [this]() {
+                return queue.size() < max_pending || error;
+            });
+            rethrow();
+        }
+        enqueue(nullptr, std::move(job));
+    }
+
+    // Wait until all the submitted jobs are done
+    void flush() {
+        std::unique_lock<std::mutex> lock(mutex);
+        cv_space.wait(lock, [this]() {
+            return (queue.empty() && !busy) || error;
+        });
+        rethrow();
+    }
+
+   private:
+    std::size_t max_pending;
+    std::thread worker;
+    std::mutex mutex;
+    std::condition_variable cv_jobs, cv_space;
+    // the snapshot used by each job (if any) and the job itself
+    std::deque<std::pair<std::unique_ptr<FieldStore<D>>, std::function<void()>>> queue;
+    std::vector<std::unique_ptr<FieldStore<D>>> spare;
+    bool stop = false;
+    bool busy = false;
+    std::exception_ptr error;
+
+    void run() {
+        while(true) {
+            std::pair<std::unique_ptr<FieldStore<D>>, std::function<void()>> item;
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                cv_jobs.wait(lock, [this]() {
+                    return !queue.empty() || stop;
+                });
+                if(queue.empty()) {
+                    return;  // stop has been requested and everything has been written
+                }
+                item = std::move(queue.front());
+                queue.pop_front();
+                busy = true;
+            }
+
+            std::exception_ptr e;
+            try {
+                item.second();
+            }
+            catch(...) {
+                e = std::current_exception();
+            }
+
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                busy = false;
+                if(item.first) {
+                    spare.push_back(std::move(item.first));
+                }
+                if(e && !error) {
+                    error = e;
+                }
+            }
+            cv_space.notify_all();
+        }
+    }
+
+    void enqueue(std::unique_ptr<FieldStore<D>> snapshot, std::function<void()> job) {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            queue.emplace_back(std::move(snapshot), std::move(job));
+        }
+        cv_jobs.notify_one();
+    }
+
+    // called with the mutex held
+    void rethrow() {
+        if(error) {
+            std::exception_ptr e = error;
+            error = nullptr;
+            std::rethrow_exception(e);
+        }
+    }
+};
+
+}  // namespace circa::io
@@ -0,0 +1,211 @@
+#pragma once
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "../core/field_store.hpp"
+#include "log.hpp"
+
+namespace circa::io {
+
+namespace detail {
+constexpr bool little_endian_host() {
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+    return false;
+#else
+    return true;
+#endif
+}
+
+template <class T>
+inline void reverse_bytes(T& v) {
+    auto* b = reinterpret_cast<unsigned char*>(&v);
+    for(std::size_t i = 0; i < sizeof(T) / 2; i++) {
+        std::swap(b[i], b[sizeof(T) - 1 - i]);
+    }
+}
+
+// copies sizeof(T) bytes from src to dst, reversing them on big-endian hosts
+template <class T>
+inline void copy_le(void* dst, const void* src) {
+    std::memcpy(dst, src, sizeof(T));
+    if constexpr (!little_endian_host()) {
+        reverse_bytes(*static_cast<T*>(dst));
+    }
+}
+
+// same as copy_le, but the bytes are reversed on little-endian hosts
+template <class T>
+inline void copy_be(void* dst, const void* src) {
+    std::memcpy(dst, src, sizeof(T));
+    if constexpr (little_endian_host()) {
+        reverse_bytes(*static_cast<T*>(dst));
+    }
+}
+
+// Little-endian serialisation of headers
+struct HeaderWriter {
+    std::vector<char> buf;
+
+    template <class T>
+    void put(T v) {
+        std::size_t pos = buf.size();
+        buf.resize(pos + sizeof(T));
+        copy_le<T>(buf.data() + pos, &v);
+    }
+
+    void put(const std::string& s) {
+        put<uint32_t>(s.size());
+        buf.insert(buf.end(), s.begin(), s.end());
+    }
+};
+
+struct HeaderReader {
+    const char* p;
+    const char* end;
+    const std::string& filename;
+
+    void need(std::size_t n) {
+        if(p > end || (std::size_t)(end - p) < n) {
+            throw std::runtime_error(fmt::format("'{}' is truncated", filename));
+        }
+    }
+
+    template <class T>
+    T get() {
+        need(sizeof(T));
+        T v;
+        copy_le<T>(&v, p);
+        p += sizeof(T);
+        return v;
+    }
+
+    std::string get_string() {
+        uint32_t len = get<uint32_t>();
+        need(len);
+        std::string s(p, len);
+        p += len;
+        return s;
+    }
+};
+
+// write(2) the whole buffer, retrying after partial writes and interruptions
+inline void write_all(int fd, const char* data, std::size_t n, const std::string& filename) {
+    while(n > 0) {
+        ssize_t w = ::write(fd, data, n);
+        if(w < 0) {
+            if(errno == EINTR) continue;
+            throw std::runtime_error(fmt::format("Error while writing '{}': {}", filename, std::strerror(errno)));
+        }
+        data += w;
+        n -= w;
+    }
+}
+// Convert n values of the given size (4 or 8 bytes), stored little-endian at src, to T
+template <class T>
+void load_values(const char* src, uint32_t bytes, T* dst, index_t n) {
+    if(bytes == sizeof(T) && little_endian_host()) {
+        std::memcpy(dst, src, n * sizeof(T));
+    }
+    else if(bytes == 8) {
+        for(index_t k = 0; k < n; k++) {
+            double v;
+            copy_le<double>(&v, src + k * 8);
+            dst[k] = T(v);
+        }
+    }
+    else {
+        for(index_t k = 0; k < n; k++) {
+            float v;
+            copy_le<float>(&v, src + k * 4);
+            dst[k] = T(v);
+        }
+    }
+}
+
+// The arrays of all the fields of S, sorted by name (so that files written from the same state are
+// always the same). The components of the interleaved fields are unpacked into storage, which must
+// outlive the result
+template <int D, class T>
+std::vector<std::pair<std::string, const T*>> field_arrays(const FieldStore<D, T>& S, std::vector<Field<D, T>>& storage) {
+    std::vector<std::pair<std::string, const T*>> fields;
+    for(const auto& kv : S.map) {
+        fields.emplace_back(kv.first, kv.second.a.data());
+    }
+    for(const auto& kv : S.multi) {
+        for(int s = 0; s < kv.second.ncomp; s++) {
+            storage.push_back(kv.second.unpack(s));
+            fields.emplace_back(kv.second.names[s], nullptr);
+        }
+    }
+    // the pointers to the unpacked components are taken only now that storage does not grow anymore
+    for(std::size_t i = 0, u = 0; i < fields.size(); i++) {
+        if(fields[i].second == nullptr) {
+            fields[i].second = storage[u++].a.data();
+        }
+    }
+    std::sort(fields.begin(), fields.end(), [](const auto& a, const auto& b) {
+        return a.first < b.first;
+    });
+    return fields;
+}
+
+// A read-only mapping of a whole file, meant to be read sequentially. Empty files are not mapped
+class MappedFile {
+   public:
+    explicit MappedFile(const std::string& filename) {
+        int fd = ::open(filename.c_str(), O_RDONLY);
+        if(fd < 0) {
+            throw std::runtime_error(fmt::format("Cannot open '{}': {}", filename, std::strerror(errno)));
+        }
+        struct stat st;
+        if(::fstat(fd, &st) != 0) {
+            ::close(fd);
+            throw std::runtime_error(fmt::format("Cannot read '{}': {}", filename, std::strerror(errno)));
+        }
+        n = st.st_size;
+        if(n > 0) {
+            void* map = ::mmap(nullptr, n, PROT_READ, MAP_PRIVATE, fd, 0);
+            if(map == MAP_FAILED) {
+                ::close(fd);
+                throw std::runtime_error(fmt::format("Cannot map '{}': {}", filename, std::strerror(errno)));
+            }
+            ::madvise(map, n, MADV_SEQUENTIAL);
+            p = static_cast<const char*>(map);
+        }
+        ::close(fd);
+    }
+
+    ~MappedFile() {
+        if(p != nullptr) {
+            ::munmap(const_cast<char*>(p), n);
+        }
+    }
+
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    const char* data() const {
+        return p;
+    }
+    std::size_t size() const {
+        return n;
+    }
+
+   private:
+    const char* p = nullptr;
+    std::size_t n = 0;
+};
+}  // namespace detail
+
+}  // namespace circa::io
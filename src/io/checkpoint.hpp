@@ -0,0 +1,182 @@
+#pragma once
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "../core/field_store.hpp"
+#include "../core/grid.hpp"
+#include "binary.hpp"
+#include "log.hpp"
+
+namespace circa::io {
+
+// Binary checkpoints. All the values are little-endian:
+//
+//   char[8]   magic ("CIRCACKP")
+//   uint32    format version
+//   uint32    D
+//   uint32    bytes per value of the field data (4 or 8)
+//   uint32    number of fields
+//   int64[D]  grid points along each dimension
+//   double[D] box size along each dimension
+//   int64     step
+//   double    t
+//   double    dt
+//   string    state of the random number generator (as written by operator<<)
+//   string[]  names of the fields
+//   uint64    offset of the field data from the beginning of the file
+//
+// where each string is a uint32 length followed by as many characters. The field data, which starts
+// at a 64-byte boundary, holds the values of the fields one after the other, in the order of their
+// names, with the same layout as Field::a. Files are written to a temporary file that is then renamed,
+// so that a run killed while writing does not leave a truncated checkpoint behind, and are read
+// through mmap.
+struct CheckpointInfo {
+    int64_t step = 0;
+    double t = 0.0;
+    double dt = 0.0;
+    std::string rng_state;
+    std::vector<std::string> names;
+};
+
+namespace detail {
+constexpr char checkpoint_magic[8] = {'C', 'I', 'R', 'C', 'A', 'C', 'K', 'P'};
+constexpr uint32_t checkpoint_version = 1;
+}  // namespace detail
+
+template <int D, class T>
+void write_checkpoint(const FieldStore<D, T>& S, const std::string& filename, const CheckpointInfo& info) {
+    std::vector<Field<D, T>> unpacked;  // components of the interleaved fields
+    const auto fields = detail::field_arrays(S, unpacked);
+
+    detail::HeaderWriter h;
+    h.buf.insert(h.buf.end(), detail::checkpoint_magic, detail::checkpoint_magic + 8);
+    h.put<uint32_t>(detail::checkpoint_version);
+    h.put<uint32_t>(D);
+    h.put<uint32_t>(sizeof(T));
+    h.put<uint32_t>(fields.size());
+    for(int d = 0; d < D; d++) {
+        h.put<int64_t>(S.g.n[d]);
+    }
+    for(int d = 0; d < D; d++) {
+        h.put<double>(S.g.L[d]);
+    }
+    h.put<int64_t>(info.step);
+    h.put<double>(info.t);
+    h.put<double>(info.dt);
+    h.put(info.rng_state);
+    for(const auto& f : fields) {
+        h.put(f.first);
+    }
+    const uint64_t offset = (h.buf.size() + sizeof(uint64_t) + 63) / 64 * 64;
+    h.put<uint64_t>(offset);
+    h.buf.resize(offset, 0);
+
+    const std::string tmp = filename + ".tmp";
+    int fd = ::open(tmp.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if(fd < 0) {
+        throw std::runtime_error(fmt::format("Cannot open '{}' for writing: {}", tmp, std::strerror(errno)));
+    }
+    try {
+        detail::write_all(fd, h.buf.data(), h.buf.size(), tmp);
+        std::vector<T> swapped;
+        for(const auto& f : fields) {
+            const char* data = reinterpret_cast<const char*>(f.second);
+            if constexpr (!detail::little_endian_host()) {
+                swapped.resize(S.g.size);
+                for(index_t i = 0; i < S.g.size; i++) {
+                    detail::copy_le<T>(&swapped[i], &f.second[i]);
+                }
+                data = reinterpret_cast<const char*>(swapped.data());
+            }
+            detail::write_all(fd, data, S.g.size * sizeof(T), tmp);
+        }
+        if(::fsync(fd) != 0) {
+            throw std::runtime_error(fmt::format("Cannot flush the checkpoint '{}': {}", tmp, std::strerror(errno)));
+        }
+    }
+    catch(...) {
+        ::close(fd);
+        ::unlink(tmp.c_str());
+        throw;
+    }
+    ::close(fd);
+    std::filesystem::rename(tmp, filename);
+}
+
+// Load the fields stored in a checkpoint into S (creating them if necessary) and return the rest of
+// its content. The grid must be the same as that of S, while the precision of the values can differ
+template <int D, class T>
+CheckpointInfo read_checkpoint(const std::string& filename, FieldStore<D, T>& S) {
+    detail::MappedFile file(filename);
+    const std::size_t size = file.size();
+    if(size == 0) {
+        throw std::runtime_error(fmt::format("Checkpoint '{}' is empty", filename));
+    }
+
+    CheckpointInfo info;
+    const char* base = file.data();
+    detail::HeaderReader h{base, base + size, filename};
+    h.need(8);
+    if(std::memcmp(base, detail::checkpoint_magic, 8) != 0) {
+        throw std::runtime_error(fmt::format("'{}' is not a checkpoint", filename));
+    }
+    h.p += 8;
+    const uint32_t version = h.get<uint32_t>();
+    if(version != detail::checkpoint_version) {
+        throw std::runtime_error(fmt::format("Checkpoint '{}' has version {}, expected {}", filename, version, detail::checkpoint_version));
+    }
+    const uint32_t dims = h.get<uint32_t>();
+    if(dims != D) {
+        throw std::runtime_error(fmt::format("Checkpoint '{}' is {}-dimensional, expected {}", filename, dims, D));
+    }
+    const uint32_t bytes = h.get<uint32_t>();
+    if(bytes != 4 && bytes != 8) {
+        throw std::runtime_error(fmt::format("Checkpoint '{}' has {}-byte values, expected 4 or 8", filename, bytes));
+    }
+    const uint32_t n_fields = h.get<uint32_t>();
+    for(int d = 0; d < D; d++) {
+        int64_t n = h.get<int64_t>();
+        if(n != S.g.n[d]) {
+            throw std::runtime_error(fmt::format("Grid size mismatch in '{}': size along the dimension {} is {}, should be {}", filename, d, n, S.g.n[d]));
+        }
+    }
+    for(int d = 0; d < D; d++) {
+        double L = h.get<double>();
+        if(std::abs(L - S.g.L[d]) > 1e-12 * std::abs(L)) {
+            CIRCA_WARN("Checkpoint '{}' has a box size of {} along the dimension {}, the configuration says {}", filename, L, d, S.g.L[d]);
+        }
+    }
+    info.step = h.get<int64_t>();
+    info.t = h.get<double>();
+    info.dt = h.get<double>();
+    info.rng_state = h.get_string();
+    for(uint32_t i = 0; i < n_fields; i++) {
+        info.names.push_back(h.get_string());
+    }
+    const uint64_t offset = h.get<uint64_t>();
+    const std::size_t field_bytes = S.g.size * bytes;
+    if(offset + n_fields * field_bytes > size) {
+        throw std::runtime_error(fmt::format("Checkpoint '{}' is truncated", filename));
+    }
+
+    for(uint32_t i = 0; i < n_fields; i++) {
+        const char* src = base + offset + i * field_bytes;
+        Field<D, T>& f = S.ensure(info.names[i]);
+        if(f.empty()) {
+            f = Field<D, T>(S.g);
+        }
+        detail::load_values(src, bytes, f.a.data(), S.g.size);
+    }
+    return info;
+}
+
+}  // namespace circa::io
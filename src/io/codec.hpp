@@ -0,0 +1,267 @@
+#pragma once
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#ifdef CIRCA_HAVE_ZLIB
+#include <zlib.h>
+#endif
+
+#include "binary.hpp"
+#include "log.hpp"
+#include "lz.hpp"
+
+namespace circa::io {
+
+// Compression of the arrays stored in binary files, which hold little-endian values of 4 or 8 bytes.
+// The value of each codec is stored in the files, and should therefore never change:
+//   NONE        the values as they are
+//   ZLIB        deflate
+//   SHUFFLE_LZ  the bytes of the values are regrouped by significance (all the first bytes, then all
+//               the second bytes, ...), which brings the slowly-varying sign and exponent bytes
+//               together, and compressed with the in-tree LZ codec (see lz.hpp). Lossless
+//   QUANTIZE    lossy: each value is replaced by the closest multiple of twice the tolerance, so that
+//               the error is at most the tolerance, and the differences between consecutive
+//               multiples are stored as variable-length integers compressed with the LZ codec.
+//               Values that cannot be represented within the tolerance are stored exactly
+enum class Codec : uint32_t {
+    NONE = 0,
+    ZLIB = 1,
+    SHUFFLE_LZ = 2,
+    QUANTIZE = 3
+};
+
+// How the values of a field are compressed
+struct Compression {
+    Codec codec = Codec::NONE;
+    int level = 1;           // zlib only: from 1 (fastest) to 9 (smallest)
+    double tolerance = 0.0;  // quantize only: maximum absolute error
+};
+
+inline Codec codec_from_name(const std::string& name) {
+    if(name == "none") return Codec::NONE;
+    if(name == "zlib") {
+#ifndef CIRCA_HAVE_ZLIB
+        CIRCA_CRITICAL("CIRCA has been compiled without zlib, the 'zlib' compression is not available");
+        throw std::runtime_error("");
+#endif
+        return Codec::ZLIB;
+    }
+    if(name == "shuffle_lz") return Codec::SHUFFLE_LZ;
+    if(name == "quantize") return Codec::QUANTIZE;
+    CIRCA_CRITICAL("Unknown compression '{}' (should be one of 'none', 'zlib', 'shuffle_lz' or 'quantize')", name);
+    throw std::runtime_error("");
+}
+
+inline const char* codec_name(Codec codec) {
+    switch(codec) {
+        case Codec::NONE: return "none";
+        case Codec::ZLIB: return "zlib";
+        case Codec::SHUFFLE_LZ: return "shuffle_lz";
+        case Codec::QUANTIZE: return "quantize";
+    }
+    return "unknown";
+}
+
+namespace detail {
+// the bytes of the n / k values of k bytes are regrouped by significance; trailing bytes are left alone
+inline void shuffle(const char* src, char* dst, std::size_t n, std::size_t k) {
+    const std::size_t nv = n / k;
+    for(std::size_t b = 0; b < k; b++) {
+        for(std::size_t i = 0; i < nv; i++) {
+            dst[b * nv + i] = src[i * k + b];
+        }
+    }
+    std::memcpy(dst + nv * k, src + nv * k, n - nv * k);
+}
+
+inline void unshuffle(const char* src, char* dst, std::size_t n, std::size_t k) {
+    const std::size_t nv = n / k;
+    for(std::size_t b = 0; b < k; b++) {
+        for(std::size_t i = 0; i < nv; i++) {
+            dst[i * k + b] = src[b * nv + i];
+        }
+    }
+    std::memcpy(dst + nv * k, src + nv * k, n - nv * k);
+}
+
+// NaNs and infinities are detected from the bits, since -ffast-math turns std::isfinite into true
+inline bool finite_bits(double v) {
+    uint64_t b;
+    std::memcpy(&b, &v, sizeof(b));
+    return ((b >> 52) & 0x7ff) != 0x7ff;
+}
+
+inline void put_varint(std::vector<char>& out, uint64_t v) {
+    while(v >= 0x80) {
+        out.push_back((char)(v | 0x80));
+        v >>= 7;
+    }
+    out.push_back((char)v);
+}
+
+inline uint64_t get_varint(const char*& p, const char* end) {
+    uint64_t v = 0;
+    for(int shift = 0; shift < 64 && p < end; shift += 7) {
+        const uint8_t b = (uint8_t)*p++;
+        v |= (uint64_t)(b & 0x7f) << shift;
+        if(b < 0x80) return v;
+    }
+    throw std::runtime_error("Corrupted quantized stream");
+}
+
+// The stream that is then compressed with LZ: the tolerance, the number of values stored exactly and
+// their (index, value) pairs, and then the differences between consecutive multiples of 2 *
+// tolerance, zigzag-encoded (so that small negative numbers are small too) as varints
+template <class T>
+std::vector<char> quantize(const char* src, std::size_t n, double tolerance) {
+    const std::size_t nv = n / sizeof(T);
+    const double step = 2.0 * tolerance;
+    std::vector<char> deltas;
+    deltas.reserve(nv);
+    HeaderWriter exact;
+    uint64_t n_exact = 0;
+    int64_t prev = 0;
+    for(std::size_t i = 0; i < nv; i++) {
+        T v;
+        copy_le<T>(&v, src + i * sizeof(T));
+        int64_t q = prev;
+        bool ok = finite_bits(v) && std::abs((double)v) < step * 0x1p52;
+        if(ok) {
+            q = (int64_t)std::nearbyint(v / step);
+            ok = std::abs((double)T(q * step) - (double)v) <= tolerance;
+        }
+        if(!ok) {
+            q = prev;
+            exact.put<uint64_t>(i);
+            exact.put<T>(v);
+            n_exact++;
+        }
+        const int64_t d = q - prev;
+        put_varint(deltas, ((uint64_t)d << 1) ^ (uint64_t)(d >> 63));
+        prev = q;
+    }
+
+    HeaderWriter out;
+    out.put<double>(tolerance);
+    out.put<uint64_t>(n_exact);
+    out.buf.insert(out.buf.end(), exact.buf.begin(), exact.buf.end());
+    out.buf.insert(out.buf.end(), deltas.begin(), deltas.end());
+    return out.buf;
+}
+
+template <class T>
+void dequantize(const std::vector<char>& stream, char* dst, std::size_t n) {
+    const std::size_t nv = n / sizeof(T);
+    const std::string name = "quantized stream";
+    HeaderReader h{stream.data(), stream.data() + stream.size(), name};
+    const double step = 2.0 * h.get<double>();
+    const uint64_t n_exact = h.get<uint64_t>();
+    HeaderReader exact = h;
+    h.need(n_exact * (sizeof(uint64_t) + sizeof(T)));
+    h.p += n_exact * (sizeof(uint64_t) + sizeof(T));
+
+    int64_t q = 0;
+    for(std::size_t i = 0; i < nv; i++) {
+        const uint64_t z = get_varint(h.p, h.end);
+        q += (int64_t)(z >> 1) ^ -(int64_t)(z & 1);
+        const T v = T(q * step);
+        copy_le<T>(dst + i * sizeof(T), &v);
+    }
+    for(uint64_t k = 0; k < n_exact; k++) {
+        const uint64_t i = exact.get<uint64_t>();
+        const T v = exact.get<T>();
+        if(i >= nv) {
+            throw std::runtime_error("Corrupted quantized stream");
+        }
+        copy_le<T>(dst + i * sizeof(T), &v);
+    }
+}
+
+// codecs made of a transform followed by LZ store the size of the transformed data first
+inline std::vector<char> with_size(const std::vector<char>& stream) {
+    HeaderWriter out;
+    out.put<uint64_t>(stream.size());
+    std::vector<char> packed = lz::compress(stream.data(), stream.size());
+    out.buf.insert(out.buf.end(), packed.begin(), packed.end());
+    return out.buf;
+}
+
+inline std::vector<char> without_size(const char* src, std::size_t n_src) {
+    const std::string name = "compressed stream";
+    HeaderReader h{src, src + n_src, name};
+    std::vector<char> stream(h.get<uint64_t>());
+    lz::decompress(h.p, n_src - sizeof(uint64_t), stream.data(), stream.size());
+    return stream;
+}
+}  // namespace detail
+
+// Compress the n bytes of src, which hold little-endian values of value_bytes (4 or 8) bytes each
+inline std::vector<char> encode(const Compression& c, const char* src, std::size_t n, std::size_t value_bytes) {
+    switch(c.codec) {
+        case Codec::NONE:
+            return std::vector<char>(src, src + n);
+        case Codec::ZLIB: {
+#ifdef CIRCA_HAVE_ZLIB
+            uLongf len = compressBound(n);
+            std::vector<char> out(len);
+            if(compress2(reinterpret_cast<Bytef*>(out.data()), &len, reinterpret_cast<const Bytef*>(src), n, c.level) != Z_OK) {
+                throw std::runtime_error("zlib compression failed");
+            }
+            out.resize(len);
+            return out;
+#else
+            break;
+#endif
+        }
+        case Codec::SHUFFLE_LZ: {
+            std::vector<char> shuffled(n);
+            detail::shuffle(src, shuffled.data(), n, value_bytes);
+            return lz::compress(shuffled.data(), n);
+        }
+        case Codec::QUANTIZE:
+            return detail::with_size((value_bytes == 4) ? detail::quantize<float>(src, n, c.tolerance) : detail::quantize<double>(src, n, c.tolerance));
+    }
+    throw std::runtime_error(fmt::format("Compression codec {} is not available", (uint32_t)c.codec));
+}
+
+// Decompress n_src bytes into the n_dst bytes of dst, which must be exactly the original size
+inline void decode(Codec codec, const char* src, std::size_t n_src, char* dst, std::size_t n_dst, std::size_t value_bytes) {
+    switch(codec) {
+        case Codec::NONE:
+            if(n_src != n_dst) break;
+            std::memcpy(dst, src, n_dst);
+            return;
+        case Codec::ZLIB: {
+#ifdef CIRCA_HAVE_ZLIB
+            uLongf len = n_dst;
+            if(uncompress(reinterpret_cast<Bytef*>(dst), &len, reinterpret_cast<const Bytef*>(src), n_src) != Z_OK || len != n_dst) break;
+            return;
+#else
+            throw std::runtime_error("CIRCA has been compiled without zlib, compressed data cannot be read");
+#endif
+        }
+        case Codec::SHUFFLE_LZ: {
+            std::vector<char> shuffled(n_dst);
+            lz::decompress(src, n_src, shuffled.data(), n_dst);
+            detail::unshuffle(shuffled.data(), dst, n_dst, value_bytes);
+            return;
+        }
+        case Codec::QUANTIZE: {
+            const std::vector<char> stream = detail::without_size(src, n_src);
+            if(value_bytes == 4) {
+                detail::dequantize<float>(stream, dst, n_dst);
+            }
+            else {
+                detail::dequantize<double>(stream, dst, n_dst);
+            }
+            return;
+        }
+    }
+    throw std::runtime_error(fmt::format("Cannot decode data compressed with the codec {}", (uint32_t)codec));
+}
+
+}  // namespace circa::io
@@ -0,0 +1,167 @@
+#pragma once
+#include <algorithm>
+#include <array>
+#include <filesystem>
+#include <map>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "../core/field_store.hpp"
+#include "../core/grid.hpp"
+#include "binary.hpp"
+#include "vtk.hpp"
+
+namespace circa::io {
+
+// A plane of grid points perpendicular to axis (0 = x, 1 = y, 2 = z), at the given index along it
+struct SliceSpec {
+    int axis;
+    int index;
+};
+
+// A reduced copy of all the fields, small enough to be taken on the fly and written later
+struct Extract {
+    std::string series;  // files are named <series>_<step>.vti
+    VtiPiece piece;
+    index_t count = 0;
+    std::vector<std::string> names;
+    std::vector<std::vector<real>> values;
+};
+
+// In-situ output: axis-aligned slices and block-averaged (downsampled) copies of the fields, which
+// are much cheaper to write than the full fields and good enough to monitor a run. Extracts are
+// taken from the state by slice() and downsample() and written by write() as .vti files, each kind
+// of extract in its own series, listed in <out_dir>/<series>.pvd. The slices keep their position in
+// the box, so that they can be shown together with the other outputs
+template <int D>
+class InSituWriter {
+   public:
+    InSituWriter(const std::string& out_dir, const std::vector<SliceSpec>& slices, int block, bool append) : out_dir(out_dir), slices(slices), block(block) {
+        std::filesystem::create_directories(out_dir);
+        std::vector<std::string> series;
+        for(const auto& s : slices) {
+            series.push_back(slice_series(s));
+        }
+        if(block > 1) {
+            series.push_back(fmt::format("down{}", block));
+        }
+        for(const auto& name : series) {
+            indices.emplace(name, std::make_unique<PvdIndex>(fmt::format("{}/{}.pvd", out_dir, name), append));
+        }
+    }
+
+    std::vector<Extract> slice(const FieldStore<D>& S) const {
+        std::vector<Extract> out;
+        for(const auto& s : slices) {
+            Extract e;
+            e.series = slice_series(s);
+            std::array<int, 3> n{}, lo{}, hi{};
+            for(int d = 0; d < 3; d++) {
+                n[d] = detail::dim_or_one<D>(S.g.n, d);
+                lo[d] = 0;
+                hi[d] = n[d] - 1;
+                e.piece.spacing[d] = detail::dx_or_one<D>(S.g.dx, d);
+            }
+            lo[s.axis] = hi[s.axis] = s.index;
+            for(int d = 0; d < 3; d++) {
+                e.piece.extent[2 * d] = lo[d];
+                e.piece.extent[2 * d + 1] = hi[d];
+            }
+            e.count = (index_t)(hi[0] - lo[0] + 1) * (hi[1] - lo[1] + 1) * (hi[2] - lo[2] + 1);
+
+            S.for_each_field([&](const std::string& name, const Field<D>& f) {
+                e.names.push_back(name);
+                auto& v = e.values.emplace_back();
+                v.reserve(e.count);
+                for(int k = lo[2]; k <= hi[2]; k++) {
+                    for(int j = lo[1]; j <= hi[1]; j++) {
+                        const real* row = f.a.data() + ((index_t)k * n[1] + j) * n[0];
+                        if(lo[0] == hi[0]) {
+                            v.push_back(row[lo[0]]);
+                        }
+                        else {
+                            v.insert(v.end(), row, row + n[0]);
+                        }
+                    }
+                }
+            });
+            out.push_back(std::move(e));
+        }
+        return out;
+    }
+
+    // The averages of the fields over blocks of block^D points, which become the points of a grid
+    // with a block times larger spacing, placed at the centres of the blocks
+    Extract downsample(const FieldStore<D>& S) const {
+        Extract e;
+        e.series = fmt::format("down{}", block);
+        std::array<int, 3> n{}, nc{};
+        for(int d = 0; d < 3; d++) {
+            n[d] = detail::dim_or_one<D>(S.g.n, d);
+            const int b = (d < D) ? block : 1;
+            nc[d] = n[d] / b;
+            const double dx = detail::dx_or_one<D>(S.g.dx, d);
+            e.piece.extent[2 * d + 1] = nc[d] - 1;
+            e.piece.spacing[d] = b * dx;
+            e.piece.origin[d] = 0.5 * (b - 1) * dx;
+        }
+        e.count = (index_t)nc[0] * nc[1] * nc[2];
+        const int bz = (D > 2) ? block : 1, by = (D > 1) ? block : 1, bx = block;
+        const double norm = 1.0 / ((double)bx * by * bz);
+
+        S.for_each_field([&](const std::string& name, const Field<D>& f) {
+            e.names.push_back(name);
+            auto& v = e.values.emplace_back(e.count, real(0));
+            // each coarse plane is summed by one thread, so that the result does not depend on their number
+#pragma omp parallel for schedule(static)
+            for(int K = 0; K < nc[2]; K++) {
+                std::vector<double> acc(nc[0]);
+                for(int J = 0; J < nc[1]; J++) {
+                    std::fill(acc.begin(), acc.end(), 0.0);
+                    for(int k = K * bz; k < (K + 1) * bz; k++) {
+                        for(int j = J * by; j < (J + 1) * by; j++) {
+                            const real* row = f.a.data() + ((index_t)k * n[1] + j) * n[0];
+                            for(int I = 0; I < nc[0]; I++) {
+                                for(int i = I * bx; i < (I + 1) * bx; i++) {
+                                    acc[I] += row[i];
+                                }
+                            }
+                        }
+                    }
+                    real* out = v.data() + ((index_t)K * nc[1] + J) * nc[0];
+                    for(int I = 0; I < nc[0]; I++) {
+                        out[I] = real(acc[I] * norm);
+                    }
+                }
+            }
+        });
+        return e;
+    }
+
+    void write(const Extract& e, int64_t step, double t) {
+        std::vector<std::pair<std::string, const real*>> fields;
+        for(std::size_t i = 0; i < e.names.size(); i++) {
+            fields.emplace_back(e.names[i], e.values[i].data());
+        }
+        std::sort(fields.begin(), fields.end(), [](const auto& a, const auto& b) {
+            return a.first < b.first;
+        });
+        const std::string name = fmt::format("{}_{}.vti", e.series, step);
+        write_vti(out_dir + "/" + name, e.piece, fields, e.count);
+        indices.at(e.series)->add(t, name);
+    }
+
+   private:
+    std::string out_dir;
+    std::vector<SliceSpec> slices;
+    int block;
+    std::map<std::string, std::unique_ptr<PvdIndex>> indices;
+
+    static std::string slice_series(const SliceSpec& s) {
+        return fmt::format("slice_{}{}", "xyz"[s.axis], s.index);
+    }
+};
+
+}  // namespace circa::io
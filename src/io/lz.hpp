@@ -0,0 +1,142 @@
+#pragma once
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+#include <vector>
+
+namespace circa::io::lz {
+
+// A small LZ77 compressor in the spirit of LZ4: greedy matching through a hash table of the last
+// position of each 4-byte sequence, byte-aligned output and no entropy coding, so that both ways run
+// at several hundred MB/s. The output is a list of sequences, each made of
+//
+//   uint8    token: number of literals (high nibble) and match length - 4 (low nibble)
+//   uint8[]  if a nibble is 15, the rest of its length, as bytes that are added up until one is < 255
+//   char[]   the literals
+//   uint16   distance of the match (little-endian)
+//
+// The last sequence has literals only, and ends the stream. The size of the decompressed data is not
+// stored: callers must know it
+namespace detail {
+constexpr int hash_bits = 16;
+constexpr std::size_t min_match = 4;
+constexpr std::size_t max_distance = 65535;
+// the last bytes are always stored as literals, so that matching never reads past the end
+constexpr std::size_t tail = 8;
+
+inline uint32_t read32(const char* p) {
+    uint32_t v;
+    std::memcpy(&v, p, 4);
+    return v;
+}
+
+inline uint32_t hash(uint32_t v) {
+    return (v * 2654435761u) >> (32 - hash_bits);
+}
+
+inline void put_length(std::vector<char>& out, std::size_t len) {
+    while(len >= 255) {
+        out.push_back((char)255);
+        len -= 255;
+    }
+    out.push_back((char)len);
+}
+
+inline void put_sequence(std::vector<char>& out, const char* literals, std::size_t n_lit, std::size_t distance, std::size_t match) {
+    const std::size_t m = (match > 0) ? match - min_match : 0;
+    out.push_back((char)(((n_lit < 15 ? n_lit : 15) << 4) | (m < 15 ? m : 15)));
+    if(n_lit >= 15) {
+        put_length(out, n_lit - 15);
+    }
+    out.insert(out.end(), literals, literals + n_lit);
+    if(match > 0) {
+        out.push_back((char)(distance & 0xff));
+        out.push_back((char)(distance >> 8));
+        if(m >= 15) {
+            put_length(out, m - 15);
+        }
+    }
+}
+}  // namespace detail
+
+inline std::vector<char> compress(const char* src, std::size_t n) {
+    std::vector<char> out;
+    out.reserve(n + n / 255 + 16);
+    // last position + 1 of each hashed sequence, 0 = none
+    std::vector<uint64_t> table(std::size_t(1) << detail::hash_bits, 0);
+
+    std::size_t anchor = 0, i = 0, misses = 0;
+    const std::size_t limit = (n > detail::tail + detail::min_match) ? n - detail::tail : 0;
+    while(i < limit) {
+        const uint32_t seq = detail::read32(src + i);
+        const uint32_t h = detail::hash(seq);
+        const uint64_t candidate = table[h];
+        table[h] = i + 1;
+        if(candidate > 0 && i - (candidate - 1) <= detail::max_distance && detail::read32(src + candidate - 1) == seq) {
+            const std::size_t from = candidate - 1;
+            std::size_t len = detail::min_match;
+            while(i + len < limit && src[from + len] == src[i + len]) {
+                len++;
+            }
+            detail::put_sequence(out, src + anchor, i - anchor, i - from, len);
+            i += len;
+            anchor = i;
+            misses = 0;
+        }
+        else {
+            // skip faster through data that does not compress
+            i += 1 + (misses++ >> 5);
+        }
+    }
+    detail::put_sequence(out, src + anchor, n - anchor, 0, 0);
+    return out;
+}
+
+// Decompress n_src bytes into exactly n_dst bytes, checking that the stream is consistent
+inline void decompress(const char* src, std::size_t n_src, char* dst, std::size_t n_dst) {
+    std::size_t ip = 0, op = 0;
+    auto corrupted = []() {
+        return std::runtime_error("Corrupted LZ stream");
+    };
+    auto length = [&](std::size_t len) {
+        if(len == 15) {
+            uint8_t b;
+            do {
+                if(ip >= n_src) throw corrupted();
+                b = (uint8_t)src[ip++];
+                len += b;
+            } while(b == 255);
+        }
+        return len;
+    };
+
+    while(ip < n_src) {
+        const uint8_t token = (uint8_t)src[ip++];
+        const std::size_t n_lit = length(token >> 4);
+        if(n_lit > n_src - ip || n_lit > n_dst - op) throw corrupted();
+        std::memcpy(dst + op, src + ip, n_lit);
+        ip += n_lit;
+        op += n_lit;
+        if(ip == n_src) break;  // the last sequence
+
+        if(n_src - ip < 2) throw corrupted();
+        const std::size_t distance = (uint8_t)src[ip] | ((std::size_t)(uint8_t)src[ip + 1] << 8);
+        ip += 2;
+        const std::size_t match = length(token & 15) + detail::min_match;
+        if(distance == 0 || distance > op || match > n_dst - op) throw corrupted();
+        const char* from = dst + op - distance;
+        if(distance >= match) {
+            std::memcpy(dst + op, from, match);
+        }
+        else {
+            // overlapping copy, which repeats the last distance bytes
+            for(std::size_t k = 0; k < match; k++) {
+                dst[op + k] = from[k];
+            }
+        }
+        op += match;
+    }
+    if(op != n_dst) throw corrupted();
+}
+
+}  // namespace circa::io::lz
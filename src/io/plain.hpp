@@ -1,36 +1,114 @@
 #pragma once
+#include <charconv>
 #include <filesystem>
 #include <fstream>
-#include <iomanip>
+#include <limits>
 #include <string>
+#include <string_view>
 #include <type_traits>
+#include <vector>
 
 #include "../core/field_store.hpp"
 #include "../core/grid.hpp"
 #include "../util/strings.h"
+#include "binary.hpp"
 
 namespace circa::io {
 
-template <int D>
-inline uint64_t init_field_from_plain(const std::string& filename, Field<D>& f) {
-    std::ifstream is(filename);
-    if(!is) {
-        throw std::runtime_error("Cannot open file: " + filename);
+namespace detail {
+// Formats text into a large buffer that is written out only when full, with the numbers converted by
+// std::to_chars, which is several times faster than going through the stream (and its locale)
+class TextBuffer {
+   public:
+    explicit TextBuffer(std::ostream& os) : os(os), buf(1 << 20) {}
+
+    ~TextBuffer() {
+        flush();
     }
 
-    std::string line;
-    // Read header line (starts with '#')
-    if(!std::getline(is, line)) {
+    void put(char c) {
+        reserve(1);
+        buf[n++] = c;
+    }
+
+    void put(std::string_view s) {
+        reserve(s.size());
+        std::memcpy(buf.data() + n, s.data(), s.size());
+        n += s.size();
+    }
+
+    // same output as os << std::setprecision(precision) << v
+    template <class T>
+    void put(T v, int precision) {
+        reserve(max_number);
+        auto res = std::to_chars(buf.data() + n, buf.data() + buf.size(), v, std::chars_format::general, precision);
+        n = res.ptr - buf.data();
+    }
+
+    void flush() {
+        os.write(buf.data(), n);
+        n = 0;
+    }
+
+   private:
+    static constexpr std::size_t max_number = 64;
+    std::ostream& os;
+    std::vector<char> buf;
+    std::size_t n = 0;
+
+    void reserve(std::size_t k) {
+        if(n + k > buf.size()) {
+            flush();
+            if(k > buf.size()) {
+                buf.resize(k);
+            }
+        }
+    }
+};
+
+// Parses the whitespace-separated numbers of a memory-mapped file with std::from_chars
+struct TextReader {
+    const char* p;
+    const char* end;
+
+    template <class T>
+    bool next(T& v) {
+        while(p < end && (*p == ' ' || *p == '\n' || *p == '\t' || *p == '\r')) {
+            p++;
+        }
+        if(p < end && *p == '+') {  // accepted by operator>>, but not by from_chars
+            p++;
+        }
+        auto res = std::from_chars(p, end, v);
+        if(res.ec != std::errc()) {
+            return false;
+        }
+        p = res.ptr;
+        return true;
+    }
+};
+}  // namespace detail
+
+template <int D, class T>
+inline uint64_t init_field_from_plain(const std::string& filename, Field<D, T>& f) {
+    detail::MappedFile file(filename);
+    if(file.size() == 0) {
         throw std::runtime_error("File is empty: " + filename);
     }
+    const char* begin = file.data();
+    const char* end = begin + file.size();
+    const char* eol = std::find(begin, end, '\n');
+
+    // Read header line (starts with '#')
+    std::string line(begin, eol);
     if(!util::starts_with(line, "#")) {
         throw std::runtime_error("Expected header starting with '#': " + filename);
     }
 
     util::trim(line);
     auto spl = util::split(line, ",");
-    uint64_t initial_time;
-    if(spl.size() == 3) {
+    uint64_t initial_time = 0;
+    if(spl.size() >= 3) {
         // parse the initial time
         auto time_spl = util::split(spl[0], "=");
         initial_time = std::stoll(time_spl[1]);
@@ -57,26 +135,13 @@ inline uint64_t init_field_from_plain(const std::string& filename, Field<D>& f)
         }
     }
 
-    // Now read data
-    if constexpr (D == 1) {
-        for(int i = 0; i < f.g.n[0]; ++i) {
-            if (!(is >> f.a[i])) {
-                throw std::runtime_error("Unexpected EOF in " + filename);
-            }
+    // Now read data: in both 1D and 2D the values are stored x fastest, like in Field::a
+    static_assert(D <= 2, "Plaintext format only defined for D=1,2");
+    detail::TextReader reader{eol, end};
+    for(index_t i = 0; i < f.g.size; ++i) {
+        if(!reader.next(f.a[i])) {
+            throw std::runtime_error("Unexpected EOF in " + filename);
         }
-    } 
-    else if constexpr (D == 2) {
-        for(int j = 0; j < f.g.n[1]; ++j) {
-            for(int i = 0; i < f.g.n[0]; ++i) {
-                int idx = j * f.g.n[0] + i;
-                if(!(is >> f.a[idx])) {
-                    throw std::runtime_error("Unexpected EOF in " + filename);
-                }
-            }
-        }
-    } 
-    else {
-        static_assert(D <= 2, "Plaintext format only defined for D=1,2");
     }
 
     return initial_time;
@@ -89,12 +154,12 @@ inline uint64_t init_field_from_plain(const std::string& filename, Field<D>& f)
 //   D=1: single column (Nx lines)
 //   D=2: Ny rows, Nx columns (matrix)
 // If append=true, header+data are appended to the file.
-template <int D>
-inline void write_field_to_plain(const Field<D>& f,
+template <int D, class T>
+inline void write_field_to_plain(const Field<D, T>& f,
                                const std::string& filename,
                                int step, double t,
                                bool append = false) {
-    if constexpr (DIM > 2) {
+    if constexpr (D > 2) {
         return;
     }
 
@@ -108,33 +173,36 @@ inline void write_field_to_plain(const Field<D>& f,
     const int nx = f.g.n[0];
     const double dx = f.g.dx[0];
 
-    os << std::setprecision(16);
+    // single-precision fields are printed with the digits required to read them back exactly
+    const int precision = std::is_same_v<T, float> ? std::numeric_limits<float>::max_digits10 : 16;
+    detail::TextBuffer out(os);
     if constexpr (D == 1) {
-        os << fmt::format("# step = {}, t = {}, size = {}, dx = {}", step, t, nx, dx) << std::endl;
+        out.put(fmt::format("# step = {}, t = {}, size = {}, dx = {}\n", step, t, nx, dx));
 
         for(int i = 0; i < nx; ++i) {
-            std::array<int, 1> I{i};
-            const int lin = flat<1>(I, f.g.n);
-            os << f.a[lin] << std::endl;
+            out.put(f.a[i], precision);
+            out.put('\n');
         }
     } 
     else if constexpr (D == 2) {
         const int ny = f.g.n[1];
         const double dy = f.g.dx[1];
 
-        os << fmt::format("# step = {}, t = {}, size = {} {}, dx = {} {}", step, t, nx, ny, dx, dy) << std::endl;
+        out.put(fmt::format("# step = {}, t = {}, size = {} {}, dx = {} {}\n", step, t, nx, ny, dx, dy));
         // Row-major print: y as rows, x as columns
         for(int j = 0; j < ny; ++j) {
+            const T* row = f.a.data() + (index_t)j * nx;
             for(int i = 0; i < nx; ++i) {
-                std::array<int, 2> I{i, j};
-                const int lin = flat<2>(I, f.g.n);
-                os << f.a[lin];
-                if (i + 1 < nx) os << " ";
+                out.put(row[i], precision);
+                out.put((i + 1 < nx) ? ' ' : '\n');
             }
-            os << std::endl;
         }
     }
-    os << std::endl;
+    out.put('\n');
+    out.flush();
+    if(!os) {
+        throw std::runtime_error(fmt::format("Error while writing '{}'", filename));
+    }
 }
 
 template <int D>
@@ -142,17 +210,14 @@ inline void dump_all_fields_plain(const FieldStore<D>& S,
                                   const std::string& prefix,
                                   int step, double t,
                                   bool append = false) {
-    if constexpr (DIM > 2) {
+    if constexpr (D > 2) {
         return;
     }
 
-    for(const auto& kv : S.map) {
-        const std::string& name = kv.first;
-        const auto& f = kv.second;
-
+    S.for_each_field([&](const std::string& name, const Field<D>& f) {
         std::string fname = prefix + "_" + name + ".dat";
         write_field_to_plain<D>(f, fname, step, t, append);
-    }
+    });
 }
 
 }  // namespace circa::io
@@ -0,0 +1,442 @@
+#pragma once
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <array>
+#include <cerrno>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <map>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "../core/field_store.hpp"
+#include "../core/grid.hpp"
+#include "binary.hpp"
+#include "codec.hpp"
+#include "log.hpp"
+
+namespace circa::io {
+
+// Binary trajectories: all the frames of a run in a single file, each frame holding all the fields,
+// with an index at the end of the file that gives direct access to any of them. All the values are
+// little-endian:
+//
+//   header:
+//     char[8]   magic ("CIRCATRJ")
+//     uint32    format version
+//     uint32    D
+//     uint32    bytes per value of the field data (4 or 8)
+//     int64[D]  grid points along each dimension
+//     double[D] box size along each dimension
+//   frames, one after the other:
+//     char[8]   magic ("CIRCAFRM")
+//     uint64    size of the rest of the frame
+//     int64     step
+//     double    t
+//     uint32    number of fields
+//     then, for each field (in the order of their names):
+//       string  name (a uint32 length followed by as many characters)
+//       uint32  codec (see codec.hpp)
+//       uint64  size of the stored data
+//       data    the values, with the same layout as Field::a, encoded with the codec
+//   index:
+//     (int64 step, double t, uint64 offset of the frame) for each frame
+//     uint64    number of frames
+//     uint64    offset of the index
+//     char[8]   magic ("CIRCAIDX")
+//
+// The index is rewritten after each frame. If it is missing (because the run was killed while
+// writing) the file is scanned and the complete frames are recovered.
+struct TrajectoryFrame {
+    int64_t step;
+    double t;
+    uint64_t offset;
+};
+
+namespace detail {
+constexpr char trajectory_magic[8] = {'C', 'I', 'R', 'C', 'A', 'T', 'R', 'J'};
+constexpr char frame_magic[8] = {'C', 'I', 'R', 'C', 'A', 'F', 'R', 'M'};
+constexpr char index_magic[8] = {'C', 'I', 'R', 'C', 'A', 'I', 'D', 'X'};
+constexpr uint32_t trajectory_version = 1;
+constexpr std::size_t index_entry = 2 * sizeof(int64_t) + sizeof(uint64_t);
+constexpr std::size_t index_tail = 2 * sizeof(uint64_t) + 8;
+
+struct TrajectoryLayout {
+    uint32_t dims;
+    uint32_t bytes;
+    std::vector<int64_t> n;
+    std::vector<double> L;
+    std::vector<TrajectoryFrame> frames;
+    uint64_t end;  // end of the last complete frame
+};
+
+inline TrajectoryLayout parse_trajectory(const char* base, std::size_t size, const std::string& filename) {
+    TrajectoryLayout layout;
+    HeaderReader h{base, base + size, filename};
+    h.need(8);
+    if(std::memcmp(base, trajectory_magic, 8) != 0) {
+        throw std::runtime_error(fmt::format("'{}' is not a trajectory", filename));
+    }
+    h.p += 8;
+    const uint32_t version = h.get<uint32_t>();
+    if(version != trajectory_version) {
+        throw std::runtime_error(fmt::format("Trajectory '{}' has version {}, expected {}", filename, version, trajectory_version));
+    }
+    layout.dims = h.get<uint32_t>();
+    layout.bytes = h.get<uint32_t>();
+    if(layout.dims < 1 || layout.dims > 3 || (layout.bytes != 4 && layout.bytes != 8)) {
+        throw std::runtime_error(fmt::format("Invalid header in the trajectory '{}'", filename));
+    }
+    for(uint32_t d = 0; d < layout.dims; d++) {
+        layout.n.push_back(h.get<int64_t>());
+    }
+    for(uint32_t d = 0; d < layout.dims; d++) {
+        layout.L.push_back(h.get<double>());
+    }
+    const uint64_t first = h.p - base;
+
+    // use the index if it is there and consistent
+    if(size >= first + index_tail && std::memcmp(base + size - 8, index_magic, 8) == 0) {
+        HeaderReader tail{base + size - index_tail, base + size, filename};
+        const uint64_t n_frames = tail.get<uint64_t>();
+        const uint64_t offset = tail.get<uint64_t>();
+        if(offset >= first && offset <= size - index_tail && n_frames == (size - index_tail - offset) / index_entry && offset + n_frames * index_entry + index_tail == size) {
+            HeaderReader idx{base + offset, base + size, filename};
+            bool valid = true;
+            for(uint64_t k = 0; k < n_frames && valid; k++) {
+                TrajectoryFrame f;
+                f.step = idx.get<int64_t>();
+                f.t = idx.get<double>();
+                f.offset = idx.get<uint64_t>();
+                // each frame starts with its magic and its length, before the index
+                valid = f.offset >= first && f.offset <= offset && offset - f.offset >= 16;
+                layout.frames.push_back(f);
+            }
+            if(valid) {
+                layout.end = offset;
+                return layout;
+            }
+            layout.frames.clear();
+        }
+    }
+
+    // otherwise recover the complete frames
+    const char* p = base + first;
+    while((std::size_t)(base + size - p) >= 16 + 2 * sizeof(int64_t) && std::memcmp(p, frame_magic, 8) == 0) {
+        HeaderReader fr{p + 8, base + size, filename};
+        const uint64_t len = fr.get<uint64_t>();
+        if(len > (uint64_t)(base + size - fr.p)) break;
+        TrajectoryFrame f;
+        f.step = fr.get<int64_t>();
+        f.t = fr.get<double>();
+        f.offset = p - base;
+        layout.frames.push_back(f);
+        p += 16 + len;
+    }
+    layout.end = p - base;
+    CIRCA_WARN("The trajectory '{}' has no valid index, {} complete frames have been recovered", filename, layout.frames.size());
+    return layout;
+}
+
+inline TrajectoryLayout parse_trajectory(const std::string& filename) {
+    MappedFile file(filename);
+    return parse_trajectory(file.data(), file.size(), filename);
+}
+}  // namespace detail
+
+// The dimensionality of the fields stored in a trajectory, which is read from the header only
+inline uint32_t trajectory_dims(const std::string& filename) {
+    std::ifstream is(filename, std::ios::binary);
+    char header[16];
+    if(!is.read(header, sizeof(header)) || std::memcmp(header, detail::trajectory_magic, 8) != 0) {
+        throw std::runtime_error(fmt::format("'{}' is not a trajectory", filename));
+    }
+    uint32_t dims;
+    detail::copy_le<uint32_t>(&dims, header + 12);
+    return dims;
+}
+
+// Appends frames to a binary trajectory. If append is false or the file does not exist a new
+// trajectory is started, otherwise the frames are added to those already there, after checking that
+// the grid and the precision are the same. Fields are compressed as set in per_field or, if they are
+// not listed there, as set by compression
+template <int D, class T = real>
+class TrajectoryWriter {
+   public:
+    TrajectoryWriter(const std::string& filename, const Grid<D>& g, bool append, Compression compression = {}, std::map<std::string, Compression> per_field = {}) : filename(filename), compression(compression), per_field(std::move(per_field)) {
+        std::error_code ec;
+        if(append && std::filesystem::file_size(filename, ec) > 0 && !ec) {
+            auto layout = detail::parse_trajectory(filename);
+            if(layout.dims != D || layout.bytes != sizeof(T)) {
+                throw std::runtime_error(fmt::format("Cannot append to the trajectory '{}': it stores {}D fields with {}-byte values", filename, layout.dims, layout.bytes));
+            }
+            for(int d = 0; d < D; d++) {
+                if(layout.n[d] != g.n[d]) {
+                    throw std::runtime_error(fmt::format("Cannot append to the trajectory '{}': its size along the dimension {} is {}, should be {}", filename, d, layout.n[d], g.n[d]));
+                }
+            }
+            frames = std::move(layout.frames);
+            end = layout.end;
+            fd = ::open(filename.c_str(), O_RDWR);
+        }
+        else {
+            fd = ::open(filename.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+        }
+        if(fd < 0) {
+            throw std::runtime_error(fmt::format("Cannot open '{}' for writing: {}", filename, std::strerror(errno)));
+        }
+
+        if(frames.empty() && end == 0) {
+            detail::HeaderWriter h;
+            h.buf.insert(h.buf.end(), detail::trajectory_magic, detail::trajectory_magic + 8);
+            h.put<uint32_t>(detail::trajectory_version);
+            h.put<uint32_t>(D);
+            h.put<uint32_t>(sizeof(T));
+            for(int d = 0; d < D; d++) {
+                h.put<int64_t>(g.n[d]);
+            }
+            for(int d = 0; d < D; d++) {
+                h.put<double>(g.L[d]);
+            }
+            seek(0);
+            detail::write_all(fd, h.buf.data(), h.buf.size(), filename);
+            end = h.buf.size();
+        }
+        write_index();
+    }
+
+    ~TrajectoryWriter() {
+        if(fd >= 0) {
+            ::close(fd);
+        }
+    }
+
+    TrajectoryWriter(const TrajectoryWriter&) = delete;
+    TrajectoryWriter& operator=(const TrajectoryWriter&) = delete;
+
+    void write(const FieldStore<D, T>& S, int64_t step, double t) {
+        std::vector<Field<D, T>> unpacked;
+        const auto fields = detail::field_arrays(S, unpacked);
+        const std::size_t bytes = S.g.size * sizeof(T);
+
+        // the data of each field, as it is going to be stored
+        std::vector<std::vector<char>> encoded(fields.size());
+        std::vector<std::pair<const char*, std::size_t>> data;
+        std::vector<Codec> codecs;
+        std::string ratios;
+        auto start_encoding = std::chrono::steady_clock::now();
+        for(std::size_t i = 0; i < fields.size(); i++) {
+            const Compression& c = compression_of(fields[i].first);
+            const char* raw = reinterpret_cast<const char*>(fields[i].second);
+            if(!detail::little_endian_host()) {
+                encoded[i].resize(bytes);
+                for(index_t k = 0; k < S.g.size; k++) {
+                    detail::copy_le<T>(encoded[i].data() + k * sizeof(T), &fields[i].second[k]);
+                }
+                raw = encoded[i].data();
+            }
+            if(c.codec != Codec::NONE) {
+                encoded[i] = encode(c, raw, bytes, sizeof(T));
+                raw = encoded[i].data();
+                ratios += fmt::format(", {} {:.2f}x", fields[i].first, (double)bytes / encoded[i].size());
+            }
+            data.emplace_back(raw, (c.codec != Codec::NONE) ? encoded[i].size() : bytes);
+            codecs.push_back(c.codec);
+        }
+        if(!ratios.empty()) {
+            std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start_encoding;
+            uint64_t stored = 0;
+            for(const auto& d : data) {
+                stored += d.second;
+            }
+            const double mb = fields.size() * bytes / 1e6;
+            CIRCA_INFO("Trajectory frame at step {}: {:.1f} MB compressed to {:.1f} MB (ratio {:.2f}{}) in {:.3f} s ({:.0f} MB/s)", step, mb, stored / 1e6, mb * 1e6 / stored, ratios, elapsed.count(), mb / elapsed.count());
+        }
+
+        detail::HeaderWriter h;
+        h.put<int64_t>(step);
+        h.put<double>(t);
+        h.put<uint32_t>(fields.size());
+        std::vector<std::size_t> field_headers;  // where the header of each field ends
+        for(std::size_t i = 0; i < fields.size(); i++) {
+            h.put(fields[i].first);
+            h.put<uint32_t>((uint32_t)codecs[i]);
+            h.put<uint64_t>(data[i].second);
+            field_headers.push_back(h.buf.size());
+        }
+        uint64_t len = 0;
+        for(std::size_t i = 0; i < fields.size(); i++) {
+            len += data[i].second;
+        }
+        len += h.buf.size();
+
+        detail::HeaderWriter start;
+        start.buf.insert(start.buf.end(), detail::frame_magic, detail::frame_magic + 8);
+        start.put<uint64_t>(len);
+
+        seek(end);
+        detail::write_all(fd, start.buf.data(), start.buf.size(), filename);
+        std::size_t from = 0;
+        for(std::size_t i = 0; i < fields.size(); i++) {
+            detail::write_all(fd, h.buf.data() + from, field_headers[i] - from, filename);
+            detail::write_all(fd, data[i].first, data[i].second, filename);
+            from = field_headers[i];
+        }
+        detail::write_all(fd, h.buf.data() + from, h.buf.size() - from, filename);
+
+        frames.push_back({step, t, end});
+        end += start.buf.size() + len;
+        write_index();
+    }
+
+    std::size_t size() const {
+        return frames.size();
+    }
+
+   private:
+    std::string filename;
+    Compression compression;
+    std::map<std::string, Compression> per_field;
+    int fd = -1;
+    std::vector<TrajectoryFrame> frames;
+    uint64_t end = 0;
+
+    const Compression& compression_of(const std::string& name) const {
+        auto it = per_field.find(name);
+        return (it != per_field.end()) ? it->second : compression;
+    }
+
+    void seek(uint64_t offset) {
+        if(::lseek(fd, offset, SEEK_SET) < 0) {
+            throw std::runtime_error(fmt::format("Cannot seek in '{}': {}", filename, std::strerror(errno)));
+        }
+    }
+
+    void write_index() {
+        detail::HeaderWriter h;
+        for(const auto& f : frames) {
+            h.put<int64_t>(f.step);
+            h.put<double>(f.t);
+            h.put<uint64_t>(f.offset);
+        }
+        h.put<uint64_t>(frames.size());
+        h.put<uint64_t>(end);
+        h.buf.insert(h.buf.end(), detail::index_magic, detail::index_magic + 8);
+        seek(end);
+        detail::write_all(fd, h.buf.data(), h.buf.size(), filename);
+        if(::ftruncate(fd, end + h.buf.size()) != 0) {
+            throw std::runtime_error(fmt::format("Cannot truncate '{}': {}", filename, std::strerror(errno)));
+        }
+    }
+};
+
+// Random access to the frames of a binary trajectory, which is memory-mapped
+template <int D, class T = real>
+class TrajectoryReader {
+   public:
+    explicit TrajectoryReader(const std::string& filename) : filename(filename), file(filename) {
+        auto layout = detail::parse_trajectory(file.data(), file.size(), filename);
+        if(layout.dims != D) {
+            throw std::runtime_error(fmt::format("Trajectory '{}' is {}-dimensional, expected {}", filename, layout.dims, D));
+        }
+        std::array<int, D> n;
+        std::array<double, D> L;
+        for(int d = 0; d < D; d++) {
+            n[d] = layout.n[d];
+            L[d] = layout.L[d];
+        }
+        g = Grid<D>(n, L);
+        bytes = layout.bytes;
+        index = std::move(layout.frames);
+    }
+
+    const Grid<D>& grid() const {
+        return g;
+    }
+
+    const std::vector<TrajectoryFrame>& frames() const {
+        return index;
+    }
+
+    // The (first) frame written at the given step
+    std::size_t find_step(int64_t step) const {
+        for(std::size_t k = 0; k < index.size(); k++) {
+            if(index[k].step == step) {
+                return k;
+            }
+        }
+        throw std::runtime_error(fmt::format("Trajectory '{}' has no frame at step {}", filename, step));
+    }
+
+    // The frame whose time is closest to t
+    std::size_t find_time(double t) const {
+        if(index.empty()) {
+            throw std::runtime_error(fmt::format("Trajectory '{}' is empty", filename));
+        }
+        std::size_t best = 0;
+        for(std::size_t k = 1; k < index.size(); k++) {
+            if(std::abs(index[k].t - t) < std::abs(index[best].t - t)) {
+                best = k;
+            }
+        }
+        return best;
+    }
+
+    // Load the fields of the k-th frame into S (creating them if necessary) and return their names
+    std::vector<std::string> read(std::size_t k, FieldStore<D, T>& S) const {
+        const char* base = file.data();
+        detail::HeaderReader h{base + index.at(k).offset, base + file.size(), filename};
+        h.need(8);
+        if(std::memcmp(h.p, detail::frame_magic, 8) != 0) {
+            throw std::runtime_error(fmt::format("Trajectory '{}' is corrupted: no frame at offset {}", filename, index[k].offset));
+        }
+        h.p += 8;
+        h.get<uint64_t>();
+        h.get<int64_t>();
+        h.get<double>();
+        const uint32_t n_fields = h.get<uint32_t>();
+
+        const std::size_t field_bytes = g.size * bytes;
+        std::vector<char> decoded;
+        std::vector<std::string> names;
+        for(uint32_t i = 0; i < n_fields; i++) {
+            names.push_back(h.get_string());
+            const Codec codec = (Codec)h.get<uint32_t>();
+            const uint64_t stored = h.get<uint64_t>();
+            h.need(stored);
+            const char* src = h.p;
+            if(codec != Codec::NONE) {
+                decoded.resize(field_bytes);
+                decode(codec, src, stored, decoded.data(), field_bytes, bytes);
+                src = decoded.data();
+            }
+            else if(stored != field_bytes) {
+                throw std::runtime_error(fmt::format("Trajectory '{}' is corrupted: field '{}' has the wrong size", filename, names.back()));
+            }
+            h.p += stored;
+
+            Field<D, T>& f = S.ensure(names.back());
+            if(f.empty()) {
+                f = Field<D, T>(S.g);
+            }
+            detail::load_values(src, bytes, f.a.data(), g.size);
+        }
+        return names;
+    }
+
+   private:
+    std::string filename;
+    detail::MappedFile file;
+    Grid<D> g;
+    uint32_t bytes;
+    std::vector<TrajectoryFrame> index;
+};
+
+}  // namespace circa::io
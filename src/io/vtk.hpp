@@ -1,15 +1,33 @@
 #pragma once
+#include <array>
+#include <cstdint>
 #include <filesystem>
 #include <fstream>
 #include <iomanip>
+#include <memory>
+#include <stdexcept>
 #include <string>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#ifdef CIRCA_HAVE_ZLIB
+#include <zlib.h>
+#endif
 
 #include "../core/field_store.hpp"
 #include "../core/grid.hpp"
+#include "binary.hpp"
+#include "log.hpp"
 
 namespace circa::io {
 
 namespace detail {
+template <class T>
+const char* vtk_type_name() {
+    return std::is_same_v<T, float> ? "float" : "double";
+}
+
 template <int D>
 int dim_or_one(const std::array<int, D>& n, int idx) {
     return (idx < D) ? n[idx] : 1;
@@ -18,12 +36,60 @@ template <int D>
 double dx_or_one(const std::array<double, D>& dx, int idx) {
     return (idx < D) ? dx[idx] : 1.0;
 }
+
+template <class T>
+const char* vti_type_name() {
+    return std::is_same_v<T, float> ? "Float32" : "Float64";
+}
+
+inline std::ofstream open_binary(const std::string& filename) {
+    std::ofstream os(filename, std::ios::binary);
+    if(!os) {
+        CIRCA_CRITICAL("Cannot open {} for writing", filename);
+        throw std::runtime_error("");
+    }
+    return os;
+}
+
+// size of the blocks the arrays of compressed .vti files are split into (the same as VTK's default)
+constexpr std::size_t vti_block = 1 << 15;
+
+// An array in the vtkZLibDataCompressor layout: the number of blocks, the uncompressed size of the
+// blocks and of the last one, the compressed size of each block, all UInt64, followed by the
+// compressed blocks
+inline std::vector<char> vti_compress(const char* data, std::size_t bytes, int level) {
+#ifdef CIRCA_HAVE_ZLIB
+    const std::size_t nb = (bytes + vti_block - 1) / vti_block;
+    std::vector<uint64_t> header(3 + nb);
+    header[0] = nb;
+    header[1] = vti_block;
+    header[2] = (bytes % vti_block == 0) ? vti_block : bytes % vti_block;
+    std::vector<char> out(header.size() * sizeof(uint64_t));
+    std::vector<Bytef> buf(compressBound(vti_block));
+    for(std::size_t b = 0; b < nb; b++) {
+        const std::size_t len = std::min(vti_block, bytes - b * vti_block);
+        uLongf clen = buf.size();
+        if(compress2(buf.data(), &clen, reinterpret_cast<const Bytef*>(data + b * vti_block), len, level) != Z_OK) {
+            throw std::runtime_error("zlib compression of a .vti array failed");
+        }
+        out.insert(out.end(), buf.begin(), buf.begin() + clen);
+        header[3 + b] = clen;
+    }
+    std::memcpy(out.data(), header.data(), header.size() * sizeof(uint64_t));
+    return out;
+#else
+    (void)data;
+    (void)bytes;
+    (void)level;
+    throw std::runtime_error("CIRCA has been compiled without zlib, .vti files cannot be compressed");
+#endif
+}
 }  // namespace detail
 
 // Write a single scalar field to VTK (STRUCTURED_POINTS, ASCII).
 // Works for D=1/2/3; for D<3 we set missing dims to 1 and nz=1 (2D) or ny=nz=1 (1D).
-template <int D>
-void write_vtk_scalar(const Field<D>& f, const std::string& filename, const std::string& scalar_name) {
+template <int D, class T>
+void write_vtk_scalar(const Field<D, T>& f, const std::string& filename, const std::string& scalar_name) {
     const int nx = detail::dim_or_one<D>(f.g.n, 0);
     const int ny = detail::dim_or_one<D>(f.g.n, 1);
     const int nz = detail::dim_or_one<D>(f.g.n, 2);
@@ -45,7 +111,7 @@ void write_vtk_scalar(const Field<D>& f, const std::string& filename, const std:
     os << "ORIGIN 0 0 0\n";
     os << "SPACING " << std::setprecision(16) << sx << " " << sy << " " << sz << "\n";
     os << "POINT_DATA " << (static_cast<size_t>(nx) * ny * nz) << "\n";
-    os << "SCALARS " << scalar_name << " double 1\n";
+    os << "SCALARS " << scalar_name << " " << detail::vtk_type_name<T>() << " 1\n";
     os << "LOOKUP_TABLE default\n";
 
     // VTK expects x fastest, then y, then z. Our flat() does x-fastest too,
@@ -65,7 +131,7 @@ void write_vtk_scalar(const Field<D>& f, const std::string& filename, const std:
                 if constexpr (D >= 3) {
                     ID[2] = I3[2];
                 }
-                const int lin = flat<D>(ID, f.g.n);
+                const index_t lin = flat<D>(ID, f.g.n);
                 os << std::setprecision(16) << f.a[lin] << "\n";
             }
         }
@@ -76,11 +142,230 @@ void write_vtk_scalar(const Field<D>& f, const std::string& filename, const std:
 template <int D>
 void dump_all_fields_vtk(const FieldStore<D>& S, const std::string& out_dir, int step) {
     std::filesystem::create_directories(out_dir);
-    for (const auto& kv : S.map) {
-        const std::string& name = kv.first;
+    S.for_each_field([&](const std::string& name, const Field<D>& f) {
         const std::string fname = fmt::format("{}/{}_{}.vtk", out_dir, name, step);
-        write_vtk_scalar(kv.second, fname, name);
+        write_vtk_scalar(f, fname, name);
+    });
+}
+
+// Write all the fields of S to a single legacy VTK file (STRUCTURED_POINTS, BINARY), one SCALARS
+// section per field. The format mandates big-endian values
+template <int D, class T>
+void write_vtk_binary(const FieldStore<D, T>& S, const std::string& filename) {
+    std::vector<Field<D, T>> unpacked;
+    const auto fields = detail::field_arrays(S, unpacked);
+
+    std::ofstream os = detail::open_binary(filename);
+    os << "# vtk DataFile Version 3.0\n";
+    os << "CIRCA fields output\n";
+    os << "BINARY\n";
+    os << "DATASET STRUCTURED_POINTS\n";
+    os << "DIMENSIONS " << detail::dim_or_one<D>(S.g.n, 0) << " " << detail::dim_or_one<D>(S.g.n, 1) << " " << detail::dim_or_one<D>(S.g.n, 2) << "\n";
+    os << "ORIGIN 0 0 0\n";
+    os << "SPACING " << std::setprecision(16) << detail::dx_or_one<D>(S.g.dx, 0) << " " << detail::dx_or_one<D>(S.g.dx, 1) << " " << detail::dx_or_one<D>(S.g.dx, 2) << "\n";
+    os << "POINT_DATA " << S.g.size << "\n";
+
+    // values are converted in chunks, so that the extra memory does not depend on the grid size
+    constexpr index_t chunk = 1 << 14;
+    std::vector<T> buf(std::min<index_t>(chunk, S.g.size));
+    for(const auto& f : fields) {
+        os << "SCALARS " << f.first << " " << detail::vtk_type_name<T>() << " 1\n";
+        os << "LOOKUP_TABLE default\n";
+        for(index_t b = 0; b < S.g.size; b += chunk) {
+            const index_t e = std::min(S.g.size, b + chunk);
+            for(index_t i = b; i < e; i++) {
+                detail::copy_be<T>(&buf[i - b], &f.second[i]);
+            }
+            os.write(reinterpret_cast<const char*>(buf.data()), (e - b) * sizeof(T));
+        }
+        os << "\n";
+    }
+    if(!os) {
+        throw std::runtime_error(fmt::format("Error while writing '{}'", filename));
     }
 }
 
+// The piece of an ImageData that is written to a .vti file: the points whose indices along x, y and
+// z range within extent (inclusive bounds), which are placed at origin + index * spacing, and the
+// values of each array on them, x fastest
+struct VtiPiece {
+    std::array<int, 6> extent{};
+    std::array<double, 3> origin{};
+    std::array<double, 3> spacing{};
+};
+
+// Write arrays of count values each to a VTK XML ImageData (.vti) file. The arrays are stored as raw
+// appended data, so that readers can seek straight to them, and are zlib-compressed if level > 0
+// (1 = fastest, 9 = smallest). Values are written in the byte order of the host, which is declared
+// in the header
+template <class T>
+void write_vti(const std::string& filename, const VtiPiece& piece, const std::vector<std::pair<std::string, const T*>>& fields, index_t count, int level = 0) {
+    const std::size_t bytes = count * sizeof(T);
+
+    std::vector<std::vector<char>> compressed;
+    std::vector<uint64_t> offsets;
+    uint64_t offset = 0;
+    for(const auto& f : fields) {
+        offsets.push_back(offset);
+        if(level > 0) {
+            compressed.push_back(detail::vti_compress(reinterpret_cast<const char*>(f.second), bytes, level));
+            offset += compressed.back().size();
+        }
+        else {
+            offset += sizeof(uint64_t) + bytes;
+        }
+    }
+
+    const auto& e = piece.extent;
+    const std::string extent = fmt::format("{} {} {} {} {} {}", e[0], e[1], e[2], e[3], e[4], e[5]);
+
+    std::ofstream os = detail::open_binary(filename);
+    os << "<?xml version=\"1.0\"?>\n";
+    os << "<VTKFile type=\"ImageData\" version=\"1.0\" byte_order=\"" << (detail::little_endian_host() ? "LittleEndian" : "BigEndian") << "\" header_type=\"UInt64\"";
+    if(level > 0) {
+        os << " compressor=\"vtkZLibDataCompressor\"";
+    }
+    os << ">\n";
+    os << std::setprecision(16);
+    os << "  <ImageData WholeExtent=\"" << extent << "\" Origin=\"" << piece.origin[0] << " " << piece.origin[1] << " " << piece.origin[2] << "\" Spacing=\"" << piece.spacing[0] << " " << piece.spacing[1] << " " << piece.spacing[2] << "\">\n";
+    os << "    <Piece Extent=\"" << extent << "\">\n";
+    os << "      <PointData" << (fields.empty() ? "" : " Scalars=\"" + fields[0].first + "\"") << ">\n";
+    for(std::size_t i = 0; i < fields.size(); i++) {
+        os << "        <DataArray type=\"" << detail::vti_type_name<T>() << "\" Name=\"" << fields[i].first << "\" format=\"appended\" offset=\"" << offsets[i] << "\"/>\n";
+    }
+    os << "      </PointData>\n";
+    os << "    </Piece>\n";
+    os << "  </ImageData>\n";
+    os << "  <AppendedData encoding=\"raw\">\n";
+    os << "   _";
+    for(std::size_t i = 0; i < fields.size(); i++) {
+        if(level > 0) {
+            os.write(compressed[i].data(), compressed[i].size());
+        }
+        else {
+            const uint64_t size = bytes;
+            os.write(reinterpret_cast<const char*>(&size), sizeof(size));
+            os.write(reinterpret_cast<const char*>(fields[i].second), bytes);
+        }
+    }
+    os << "\n  </AppendedData>\n";
+    os << "</VTKFile>\n";
+    if(!os) {
+        throw std::runtime_error(fmt::format("Error while writing '{}'", filename));
+    }
+}
+
+// Write all the fields of S to a single .vti file
+template <int D, class T>
+void write_vti(const FieldStore<D, T>& S, const std::string& filename, int level = 0) {
+    std::vector<Field<D, T>> unpacked;
+    const auto fields = detail::field_arrays(S, unpacked);
+    VtiPiece piece;
+    for(int d = 0; d < 3; d++) {
+        piece.extent[2 * d + 1] = detail::dim_or_one<D>(S.g.n, d) - 1;
+        piece.spacing[d] = detail::dx_or_one<D>(S.g.dx, d);
+    }
+    write_vti(filename, piece, fields, S.g.size, level);
+}
+
+// A ParaView collection (.pvd) that lists the files of a time series together with their times. The
+// file is rewritten (atomically) every time an entry is added, so that it is always complete. If
+// append is true the entries of an existing file are kept
+class PvdIndex {
+   public:
+    PvdIndex(const std::string& filename, bool append) : filename(filename) {
+        std::ifstream is(filename);
+        std::string line;
+        while(append && std::getline(is, line)) {
+            if(line.find("<DataSet ") != std::string::npos) {
+                entries.push_back(line);
+            }
+        }
+    }
+
+    // file should be relative to the directory of the index
+    void add(double t, const std::string& file) {
+        entries.push_back(fmt::format("    <DataSet timestep=\"{}\" group=\"\" part=\"0\" file=\"{}\"/>", t, file));
+
+        const std::string tmp = filename + ".tmp";
+        {
+            std::ofstream os(tmp);
+            if(!os) {
+                CIRCA_CRITICAL("Cannot open {} for writing", tmp);
+                throw std::runtime_error("");
+            }
+            os << "<?xml version=\"1.0\"?>\n";
+            os << "<VTKFile type=\"Collection\" version=\"0.1\">\n";
+            os << "  <Collection>\n";
+            for(const auto& e : entries) {
+                os << e << "\n";
+            }
+            os << "  </Collection>\n";
+            os << "</VTKFile>\n";
+        }
+        std::filesystem::rename(tmp, filename);
+    }
+
+   private:
+    std::string filename;
+    std::vector<std::string> entries;
+};
+
+enum class VtkFormat {
+    ASCII,   // one legacy ASCII file per field and step
+    BINARY,  // one legacy binary file per step
+    VTI      // one XML ImageData file per step, indexed by a .pvd collection
+};
+
+inline VtkFormat vtk_format_from_name(const std::string& name) {
+    if(name == "ascii") return VtkFormat::ASCII;
+    if(name == "binary") return VtkFormat::BINARY;
+    if(name == "vti") return VtkFormat::VTI;
+    CIRCA_CRITICAL("Unknown VTK format '{}' (should be one of 'ascii', 'binary' or 'vti')", name);
+    throw std::runtime_error("");
+}
+
+// Writes the configurations in the chosen VTK format to out_dir: the binary formats store all the
+// fields of a step in <out_dir>/fields_<step>.vtk or .vti, and the .vti files are listed in
+// <out_dir>/fields.pvd, which can be opened in ParaView as a time series
+template <int D>
+class VtkWriter {
+   public:
+    VtkWriter(const std::string& out_dir, VtkFormat format, int level, bool append) : out_dir(out_dir), format(format), level(level) {
+        std::filesystem::create_directories(out_dir);
+        if(format == VtkFormat::VTI) {
+#ifndef CIRCA_HAVE_ZLIB
+            if(this->level > 0) {
+                CIRCA_WARN("CIRCA has been compiled without zlib, the .vti files will not be compressed");
+                this->level = 0;
+            }
+#endif
+            index = std::make_unique<PvdIndex>(out_dir + "/fields.pvd", append);
+        }
+    }
+
+    void write(const FieldStore<D>& S, int64_t step, double t) {
+        switch(format) {
+            case VtkFormat::ASCII:
+                dump_all_fields_vtk<D>(S, out_dir, step);
+                break;
+            case VtkFormat::BINARY:
+                write_vtk_binary(S, fmt::format("{}/fields_{}.vtk", out_dir, step));
+                break;
+            case VtkFormat::VTI: {
+                const std::string name = fmt::format("fields_{}.vti", step);
+                write_vti(S, out_dir + "/" + name, level);
+                index->add(t, name);
+                break;
+            }
+        }
+    }
+
+   private:
+    std::string out_dir;
+    VtkFormat format;
+    int level;
+    std::unique_ptr<PvdIndex> index;
+};
+
 }  // namespace circa::io
@@ -1,14 +1,23 @@
+#include <algorithm>
+#include <chrono>
 #include <iostream>
 #include <random>
+#include <sstream>
 
 #include "core/diagnostics.hpp"
 #include "core/field_store.hpp"
 #include "core/grid.hpp"
 #include "core/system.hpp"
 #include "integrators/registry.hpp"
+#include "io/async_writer.hpp"
+#include "io/checkpoint.hpp"
+#include "io/insitu.hpp"
 #include "io/log.hpp"
 #include "io/plain.hpp"
+#include "io/trajectory.hpp"
 #include "io/vtk.hpp"
+#include "ops/fd_autotune.hpp"
+#include "ops/fd_shapes.hpp"
 #include "util/config.hpp"
 
 #include <spdlog/include/spdlog/fmt/ranges.h>
@@ -33,6 +42,16 @@ int main(int argc, char *argv[]) {
         Grid<DIM> grid(config.grid.n, config.grid.L);
 
         CIRCA_INFO("Grid: points = {}, n = {}, L = {}, dx = {}, dV = {}", grid.size, fmt::join(grid.n, " "), fmt::join(grid.L, " "), fmt::join(grid.dx, " "), grid.dV);
+        if constexpr (DIM == 3) {
+            if(config.grid.autotune_tiles) {
+                auto cache = config.grid.tile_cache.empty() ? circa::fd::default_tile_cache() : config.grid.tile_cache;
+                circa::fd::autotune_tile<real>(grid, cache);
+            }
+            else {
+                circa::fd::active_tile() = circa::fd::Tile{config.grid.tiles[0], config.grid.tiles[1]};
+                CIRCA_INFO("Using y-z tile sizes {} x {} (0 = no tiling)", config.grid.tiles[0], config.grid.tiles[1]);
+            }
+        }
 
         FieldStore<DIM> S(grid);
         FieldStore<DIM> scratch(grid); // used later as a placeholder
@@ -40,8 +59,31 @@ int main(int argc, char *argv[]) {
         uint64_t initial_step = 0;
         bool step_parsed = false;
 
-        // initialise the fields
-        for(uint32_t i = 0; i < config.fields.names.size(); i++) {
+        // restart from a checkpoint, or initialise the fields
+        if(!config.checkpoint.restart.empty()) {
+            auto start = std::chrono::steady_clock::now();
+            auto info = circa::io::read_checkpoint<DIM>(config.checkpoint.restart, S);
+            std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+            CIRCA_INFO("Restarting from the checkpoint '{}' (step = {}, t = {}), loaded in {:.3f} s", config.checkpoint.restart, info.step, info.t, elapsed.count());
+
+            for(const auto& name : config.fields.names) {
+                if(std::find(info.names.begin(), info.names.end(), name) == info.names.end()) {
+                    throw std::runtime_error(fmt::format("Field '{}' is missing from the checkpoint '{}'", name, config.checkpoint.restart));
+                }
+            }
+            for(const auto& name : info.names) {
+                if(std::find(config.fields.names.begin(), config.fields.names.end(), name) == config.fields.names.end()) {
+                    CIRCA_WARN("Field '{}' of the checkpoint is not in the configuration and will be ignored", name);
+                    S.map.erase(name);
+                }
+            }
+            if(info.dt != config.time.dt) {
+                CIRCA_WARN("The checkpoint was written with dt = {}, the configuration says {}", info.dt, config.time.dt);
+            }
+            std::istringstream(info.rng_state) >> rng;
+            initial_step = info.step;
+        }
+        for(uint32_t i = 0; i < config.fields.names.size() && config.checkpoint.restart.empty(); i++) {
             auto name = config.fields.names[i];
             S.ensure(name);
             auto strat = config.fields.init_strategies[i];
@@ -53,7 +95,7 @@ int main(int argc, char *argv[]) {
                 case strat.RANDOM: {
                     CIRCA_INFO("Initialising '{}' field with random values (mean = {}, std_dev = {})", name, strat.average, strat.random_stddev);
                     std::normal_distribution<double> gaussian(strat.average, strat.random_stddev);
-                    for(int i = 0; i < grid.size; i++) {
+                    for(index_t i = 0; i < grid.size; i++) {
                         S.map[name].a[i] = gaussian(rng);
                     }
                     break;
@@ -89,10 +131,29 @@ int main(int argc, char *argv[]) {
         }
         auto stepper = it->second(config, config.build_system_fn, S);
 
-        circa::io::dump_all_fields_plain<DIM>(S, "init", 0, 0.0, false);
+        // configurations are written by a background thread (if output_queue > 0). The VTK, in-situ
+        // and trajectory writers are used only by its jobs, and must outlive them
+        std::unique_ptr<circa::io::VtkWriter<DIM>> vtk;
         if(config.out.print_vtk) {
-            circa::io::dump_all_fields_vtk<DIM>(S, config.out.vtk_dir, initial_step);
+            vtk = std::make_unique<circa::io::VtkWriter<DIM>>(config.out.vtk_dir, circa::io::vtk_format_from_name(config.out.vtk_format), config.out.vtk_compression, config.out.output_append);
+        }
+        std::unique_ptr<circa::io::InSituWriter<DIM>> insitu;
+        const bool slicing = !config.out.slices.empty() && config.out.slice_every > 0;
+        const bool downsampling = config.out.downsample > 1 && config.out.downsample_every > 0;
+        if(slicing || downsampling) {
+            insitu = std::make_unique<circa::io::InSituWriter<DIM>>(config.out.vtk_dir, slicing ? config.out.slices : std::vector<circa::io::SliceSpec>{}, downsampling ? config.out.downsample : 0, config.out.output_append);
         }
+        std::unique_ptr<circa::io::TrajectoryWriter<DIM>> trajectory;
+        if(config.out.trajectory_format == "binary") {
+            trajectory = std::make_unique<circa::io::TrajectoryWriter<DIM>>(config.out.trajectory_filename, grid, config.out.output_append, config.out.trajectory_compression, config.out.field_compression);
+        }
+        circa::io::AsyncWriter<DIM> writer(config.out.output_queue);
+        writer.submit(S, [&vtk, &config, initial_step](const FieldStore<DIM>& snap) {
+            circa::io::dump_all_fields_plain<DIM>(snap, "init", 0, 0.0, false);
+            if(vtk) {
+                vtk->write(snap, initial_step, initial_step * config.time.dt);
+            }
+        });
 
         auto diag_sys = config.build_system_fn(S, scratch);
 
@@ -100,45 +161,152 @@ int main(int argc, char *argv[]) {
         std::ios_base::openmode openmode = (config.out.output_append) ? std::ios_base::app : std::ios_base::out;
         std::ofstream output("energy.dat", openmode);
         int64_t step;
-        double t;
-        for(step = initial_step; step <= initial_step + config.time.steps; step++) {
-            t = step * config.time.dt;
-            if(step % config.out.output_every == 0) {
-                double m_avg = 0.0;
-                for(auto &s : config.out.mass_fields) {
-                    m_avg += mean(S.map[s]) * grid.dV;
-                }
+        double t = initial_step * config.time.dt;
+        const int64_t last_step = initial_step + config.time.steps;
+        // the first step after s that is a multiple of every
+        auto next_multiple = [](int64_t s, int64_t every) { return (s / every + 1) * every; };
+        auto save_checkpoint = [&](int64_t at_step) {
+            std::ostringstream rng_state;
+            rng_state << rng;
+            circa::io::CheckpointInfo info{at_step, at_step * config.time.dt, config.time.dt, rng_state.str(), {}};
+            writer.submit(S, [&config, info](const FieldStore<DIM>& snap) {
+                auto start = std::chrono::steady_clock::now();
+                circa::io::write_checkpoint<DIM>(snap, config.checkpoint.filename, info);
+                std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+                CIRCA_INFO("Checkpoint for step {} written to '{}' in {:.3f} s", info.step, config.checkpoint.filename, elapsed.count());
+            });
+        };
 
-                double FE_avg = circa::Diagnostics<DIM>::total_free_energy(diag_sys) * grid.dV / grid.size;
-                auto output_line = fmt::format("{:.5f} {:.8f} {:.5f} {:L}", t, FE_avg, m_avg, step);
+        // per-term energies and wall times (the latter over the interval between two lines)
+        std::ofstream terms_output;
+        if(!config.out.terms_filename.empty()) {
+            terms_output.open(config.out.terms_filename, openmode);
+            if(!config.out.output_append) {
+                std::string header = "# t step";
+                for(const auto& term : diag_sys.terms) header += " E[" + term->id + "]";
+                for(const auto& term : diag_sys.terms) header += " wall[" + term->id + "]";
+                terms_output << header << std::endl;
+                terms_output << "# the wall time of a term fused into another one is included in the latter's" << std::endl;
+            }
+        }
+        std::vector<double> last_seconds(diag_sys.terms.size(), 0.0);
 
-                std::cout << output_line << std::endl;
-                output << output_line << std::endl;
+        // values of the next line of the energy file, which may have to wait for the energy
+        struct Line {
+            double t, m_avg;
+            int64_t step;
+            std::vector<double> seconds;
+        } pending_line{};
+        bool energy_requested = false;
+        auto print_line = [&](const std::vector<double>& E_terms) {
+            double FE = 0.0;
+            for(double E : E_terms) {
+                FE += E;
             }
-            if(step > initial_step && step % config.out.conf_every == 0) {
-                circa::io::dump_all_fields_plain<DIM>(S, "last", step, t, false);
+            double FE_avg = FE * grid.dV / grid.size;
+            auto output_line = fmt::format("{:.5f} {:.8f} {:.5f} {:L}", pending_line.t, FE_avg, pending_line.m_avg, pending_line.step);
+
+            std::cout << output_line << std::endl;
+            output << output_line << std::endl;
 
-                if(config.out.print_vtk) {
-                    circa::io::dump_all_fields_vtk<DIM>(S, config.out.vtk_dir, step);
+            if(terms_output.is_open()) {
+                std::string terms_line = fmt::format("{:.5f} {:L}", pending_line.t, pending_line.step);
+                for(double E : E_terms) {
+                    terms_line += fmt::format(" {:.8f}", E * grid.dV / grid.size);
                 }
+                for(std::size_t i = 0; i < last_seconds.size(); i++) {
+                    const double now = (i < pending_line.seconds.size()) ? pending_line.seconds[i] : 0.0;
+                    terms_line += fmt::format(" {:.6f}", now - last_seconds[i]);
+                    last_seconds[i] = now;
+                }
+                terms_output << terms_line << std::endl;
+            }
+        };
+        for(step = initial_step; step <= last_step;) {
+            t = step * config.time.dt;
+            if(step % config.out.output_every == 0) {
+                double m_avg = 0.0;
+                S.for_each_field([&](const std::string& name, const Field<DIM>& f) {
+                    auto &mf = config.out.mass_fields;
+                    if(std::find(mf.begin(), mf.end(), name) != mf.end()) {
+                        m_avg += mean(f) * grid.dV;
+                    }
+                });
 
+                // the energy is computed by the integrator during the next step if it can, otherwise here
+                pending_line = Line{t, m_avg, step, stepper->term_seconds()};
+                energy_requested = stepper->request_energy();
+                if(!energy_requested) {
+                    print_line(circa::Diagnostics<DIM>::free_energies(diag_sys));
+                }
+            }
+            if(config.checkpoint.every > 0 && step > (int64_t)initial_step && step % config.checkpoint.every == 0) {
+                save_checkpoint(step);
+            }
+            // slices and downsampled copies are extracted here, and only the (small) extracts are queued
+            if(slicing && step > (int64_t)initial_step && step % config.out.slice_every == 0) {
+                writer.post([&insitu, extracts = insitu->slice(S), step, t]() {
+                    for(const auto& e : extracts) {
+                        insitu->write(e, step, t);
+                    }
+                });
+            }
+            if(downsampling && step > (int64_t)initial_step && step % config.out.downsample_every == 0) {
+                writer.post([&insitu, extract = insitu->downsample(S), step, t]() {
+                    insitu->write(extract, step, t);
+                });
+            }
+            if(config.out.conf_every > 0 && step > (int64_t)initial_step && step % config.out.conf_every == 0) {
                 // here we make sure that we append to the trajectory file if we are not at the first dump
                 // or if the user requested appending
                 static bool printed_once = false;
-                if(!printed_once && !config.out.output_append) {
-                    circa::io::dump_all_fields_plain<DIM>(S, "trajectory", step, t, false);
-                    printed_once = true;
-                }
-                else {
-                    circa::io::dump_all_fields_plain<DIM>(S, "trajectory", step, t, true);
+                const bool append_trajectory = printed_once || config.out.output_append;
+                printed_once = true;
+
+                writer.submit(S, [&vtk, &trajectory, step, t, append_trajectory](const FieldStore<DIM>& snap) {
+                    circa::io::dump_all_fields_plain<DIM>(snap, "last", step, t, false);
+
+                    if(vtk) {
+                        vtk->write(snap, step, t);
+                    }
+
+                    if(trajectory) {
+                        trajectory->write(snap, step, t);
+                    }
+                    else {
+                        circa::io::dump_all_fields_plain<DIM>(snap, "trajectory", step, t, append_trajectory);
+                    }
+                });
+            }
+            // advance straight to the next step at which something has to be done, so that integrators
+            // can work on several steps at once
+            int64_t next = last_step + 1;
+            if(step < last_step) {
+                next = std::min(next_multiple(step, config.out.output_every), last_step);
+                for(int every : {config.out.conf_every, config.checkpoint.every, slicing ? config.out.slice_every : 0, downsampling ? config.out.downsample_every : 0}) {
+                    if(every > 0) {
+                        next = std::min(next, next_multiple(step, every));
+                    }
                 }
             }
-            stepper->step(S, config.time.dt);
+            stepper->advance(S, config.time.dt, next - step);
+            if(energy_requested) {
+                print_line(stepper->recorded_energies());
+                energy_requested = false;
+            }
+            step = next;
         }
 
-        circa::io::dump_all_fields_plain<DIM>(S, "last", step, t, false);
+        writer.submit(S, [step, t](const FieldStore<DIM>& snap) {
+            circa::io::dump_all_fields_plain<DIM>(snap, "last", step, t, false);
+        });
+        if(config.checkpoint.every > 0) {
+            save_checkpoint(step);
+        }
+        writer.flush();
 
         output.close();
+        terms_output.close();
 
         CIRCA_INFO("END OF SIMULATION");
     }
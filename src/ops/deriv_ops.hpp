@@ -5,12 +5,17 @@
 
 namespace circa {
 
-template <int D>
+template <int D, class T = real>
 struct DerivOps {
     virtual ~DerivOps() = default;
-    virtual Field<D> laplacian(const Field<D>& f) const = 0;
-    virtual std::array<Field<D>, D> gradient(const Field<D>& f) const = 0;
-    virtual Field<D> divergence(const std::array<Field<D>, D>& v) const = 0;
+    virtual Field<D, T> laplacian(const Field<D, T>& f) const = 0;
+    virtual std::array<Field<D, T>, D> gradient(const Field<D, T>& f) const = 0;
+    virtual Field<D, T> divergence(const std::array<Field<D, T>, D>& v) const = 0;
+
+    // Same as above, but the results are written into caller-provided (e.g. workspace) fields
+    virtual void laplacian(const Field<D, T>& f, Field<D, T>& out) const = 0;
+    virtual void gradient(const Field<D, T>& f, std::array<Field<D, T>, D>& out) const = 0;
+    virtual void divergence(const std::array<Field<D, T>, D>& v, Field<D, T>& out) const = 0;
 };
 
 }  // namespace circa
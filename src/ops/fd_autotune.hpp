@@ -0,0 +1,164 @@
+#pragma once
+#include <unistd.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "../io/log.hpp"
+#include "fd_ops.hpp"
+#include "fd_shapes.hpp"
+
+namespace circa::fd {
+
+// Default location of the file where autotuned tile sizes are stored:
+// $XDG_CACHE_HOME/circa/fd_tiles.txt, ~/.cache/circa/fd_tiles.txt or ./fd_tiles.txt
+inline std::string default_tile_cache() {
+    if(const char* xdg = std::getenv("XDG_CACHE_HOME")) {
+        return std::string(xdg) + "/circa/fd_tiles.txt";
+    }
+    if(const char* home = std::getenv("HOME")) {
+        return std::string(home) + "/.cache/circa/fd_tiles.txt";
+    }
+    return "fd_tiles.txt";
+}
+
+namespace detail {
+// tile sizes are specific to the machine, the grid shape and the storage type
+template <class T>
+std::string tile_key(const std::array<int, 3>& n) {
+    char host[256] = "unknown";
+    gethostname(host, sizeof(host) - 1);
+    return fmt::format("{} {} {} {} {}", host, n[0], n[1], n[2], sizeof(T));
+}
+
+// each line of the cache file reads "host nx ny nz sizeof(T) tile_y tile_z"
+inline bool read_cached_tile(const std::string& filename, const std::string& key, Tile& tile) {
+    std::ifstream is(filename);
+    std::string line;
+    bool found = false;
+    while(std::getline(is, line)) {
+        if(line.compare(0, key.size() + 1, key + " ") == 0) {
+            std::istringstream ss(line.substr(key.size()));
+            Tile t;
+            if(ss >> t.y >> t.z) {
+                tile = t;
+                found = true;  // later entries override earlier ones
+            }
+        }
+    }
+    return found;
+}
+
+inline void write_cached_tile(const std::string& filename, const std::string& key, const Tile& tile) {
+    std::error_code ec;
+    auto dir = std::filesystem::path(filename).parent_path();
+    if(!dir.empty()) {
+        std::filesystem::create_directories(dir, ec);
+    }
+    std::ofstream os(filename, std::ios::app);
+    if(!os) {
+        CIRCA_WARN("Cannot write the tile sizes to '{}', they will be autotuned again next time", filename);
+        return;
+    }
+    os << key << " " << tile.y << " " << tile.z << std::endl;
+}
+
+// the tile sizes smaller than the extent of the slab along a direction, plus one as large as the slab,
+// which means no tiling if the slab spans the whole grid along that direction
+inline std::vector<int> tile_candidates(int extent, int grid_extent, std::initializer_list<int> sizes) {
+    std::vector<int> c;
+    for(int s : sizes) {
+        if(s < extent) {
+            c.push_back(s);
+        }
+    }
+    c.push_back((extent < grid_extent) ? extent : 0);
+    return c;
+}
+
+// upper bound on the number of points of the slab used for autotuning (three fields of this size are
+// allocated), unless the x-y planes are so large that the minimum slab below is already bigger
+constexpr index_t max_autotune_points = index_t(1) << 21;
+
+// The slab keeps whole rows along x, whose length sets how the kernels vectorise, and is cut along z
+// and then y to stay within max_autotune_points. It keeps at least 16 planes and 128 rows, so that
+// the larger candidates are still meaningful
+inline std::array<int, 3> autotune_slab(const std::array<int, 3>& n) {
+    const index_t nx = n[0];
+    const index_t nz = std::clamp<index_t>(max_autotune_points / (nx * n[1]), std::min(n[2], 16), std::min(n[2], 64));
+    const index_t ny = std::clamp<index_t>(max_autotune_points / (nx * nz), std::min(n[1], 128), n[1]);
+    return {n[0], (int)ny, (int)nz};
+}
+
+template <class T>
+Tile autotune_tile_3d(const std::array<int, 3>& n, const std::string& cache_file) {
+    const std::string key = tile_key<T>(n);
+    Tile best;
+    if(read_cached_tile(cache_file, key, best)) {
+        CIRCA_INFO("Using the y-z tile sizes {} x {} found in '{}'", best.y, best.z, cache_file);
+        active_tile() = best;
+        return best;
+    }
+
+    const std::array<int, 3> slab = autotune_slab(n);
+    CIRCA_INFO("Autotuning the y-z tile sizes on a {} x {} x {} slab of the grid", slab[0], slab[1], slab[2]);
+    Grid<3> g(slab, {(double)slab[0], (double)slab[1], (double)slab[2]});
+    Field<3, T> M(g), mu(g), out(g);
+    for(index_t i = 0; i < g.size; i++) {
+        M.a[i] = T(1.0 + 0.1 * ((i * 7919) % 101) / 101.0);
+        mu.a[i] = T(0.5 - ((i * 104729) % 211) / 211.0);
+    }
+
+    FDOps<3, T> ops;
+    double best_time = -1.0;
+    for(int ty : tile_candidates(slab[1], n[1], {4, 8, 16, 32, 64})) {
+        for(int tz : tile_candidates(slab[2], n[2], {8, 16, 32})) {
+            active_tile() = Tile{ty, tz};
+            double elapsed = -1.0;
+            // the first repetition also warms up the cache and the page tables
+            for(int rep = 0; rep < 3; rep++) {
+                auto start = std::chrono::steady_clock::now();
+                ops.laplacian(mu, out);
+                ops.div_M_grad(M, mu, out);
+                std::chrono::duration<double> dt = std::chrono::steady_clock::now() - start;
+                if(rep > 0 && (elapsed < 0.0 || dt.count() < elapsed)) {
+                    elapsed = dt.count();
+                }
+            }
+            if(best_time < 0.0 || elapsed < best_time) {
+                best_time = elapsed;
+                best = Tile{ty, tz};
+            }
+        }
+    }
+
+    CIRCA_INFO("Autotuned y-z tile sizes: {} x {} (0 = no tiling), stored in '{}'", best.y, best.z, cache_file);
+    write_cached_tile(cache_file, key, best);
+    active_tile() = best;
+    return best;
+}
+
+}  // namespace detail
+
+// Pick the y-z tile sizes that make the 3D stencils fastest on the grid g, either from the
+// cache file or by timing the laplacian and div_M_grad kernels on a slab of the grid (same rows along
+// x, about max_autotune_points points at most, see autotune_slab) for a handful of candidates.
+// Returns the chosen sizes and makes them active. Tiling is used only in 3D, so that this is a no-op
+// for D < 3
+template <class T = real, int D>
+Tile autotune_tile(const Grid<D>& g, const std::string& cache_file) {
+    if constexpr (D != 3) {
+        return active_tile();
+    }
+    else {
+        return detail::autotune_tile_3d<T>(g.n, cache_file);
+    }
+}
+
+}  // namespace circa::fd
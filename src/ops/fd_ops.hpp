@@ -1,94 +1,348 @@
 #pragma once
+#include <cmath>
+#include <stdexcept>
+
 #include "../core/grid.hpp"
 #include "deriv_ops.hpp"
+#include "fd_shapes.hpp"
 
 namespace circa {
 
-template <int D>
-struct FDOps : DerivOps<D> {
-    Field<D> laplacian(const Field<D> &f) const override {
-        Field<D> out(f.g);
-        for(int i = 0; i < f.g.size; i++) {
-            auto I = unflat<D>(i, f.g.n);
-            double acc = 0.0;
-            for(int d = 0; d < D; d++) {
-                auto Ip = I, Im = I;
-                Ip[d] = (I[d] + 1 == f.g.n[d]) ? 0 : I[d] + 1;
-                Im[d] = (I[d] == 0) ? f.g.n[d] - 1 : I[d] - 1;
-                acc += (f.a[flat<D>(Ip, f.g.n)] - 2.0 * f.a[i] + f.a[flat<D>(Im, f.g.n)]) / (f.g.dx[d] * f.g.dx[d]);
-            }
-            out.a[i] = acc;
-        }
+// STANDARD: the axial 3 points per dimension (5 points if order = 4)
+// ISOTROPIC: 9 points in 2D, 19 points in 3D; ISOTROPIC_27: 27 points in 3D. Both are second order
+enum class FDStencil { STANDARD, ISOTROPIC, ISOTROPIC_27 };
+
+// T is the storage type of the fields: values are always promoted to double before being combined
+template <int D, class T = real>
+struct FDOps : DerivOps<D, T> {
+    int order = 2;  // 2 or 4, STANDARD stencils only
+    FDStencil stencil = FDStencil::STANDARD;
+
+    FDOps() = default;
+    FDOps(int order_, FDStencil stencil_) : order(order_), stencil(stencil_) {}
+
+    // how many sites away (along any direction) the laplacian and div_M_grad stencils look
+    int laplacian_reach() const {
+        return (order == 4) ? 2 : 1;
+    }
+
+    int div_M_grad_reach() const {
+        return (order == 4) ? 3 : 1;
+    }
+
+    Field<D, T> laplacian(const Field<D, T> &f) const override {
+        Field<D, T> out(f.g);
+        laplacian(f, out);
+        return out;
+    }
+
+    std::array<Field<D, T>, D> gradient(const Field<D, T> &f) const override {
+        std::array<Field<D, T>, D> g{Field<D, T>(f.g)};
+        for(int d = 1; d < D; ++d) g[d] = Field<D, T>(f.g);
+        gradient(f, g);
+        return g;
+    }
+
+    Field<D, T> divergence(const std::array<Field<D, T>, D> &v) const override {
+        Field<D, T> out(v[0].g);
+        divergence(v, out);
+        return out;
+    }
+
+    // Divergence of M * gradient of mu, where M is a scalar field
+    Field<D, T> div_M_grad(const Field<D, T> &M, const Field<D, T> &mu) const {
+        Field<D, T> out(mu.g);
+        div_M_grad(M, mu, out);
         return out;
     }
+
+    // The variants that follow write into `out`, which must be defined on the same grid as the input.
+    // The grid is traversed row by row (see fd_shapes.hpp).
+    void laplacian(const Field<D, T> &f, Field<D, T> &out) const override {
+        if(stencil != FDStencil::STANDARD) {
+            laplacian_isotropic(f, out);
+            return;
+        }
+        if(order == 4) {
+            laplacian_4th(f, out);
+            return;
+        }
+        const T *a = f.a.data();
+        T *o = out.a.data();
+        const auto &dx = f.g.dx;
+        const auto &n = f.g.n;
+        fd::for_each_row<D>(n, [&](index_t b, const auto &bp, const auto &bm) {
+            fd::sweep_x(n, [&](int x, int xp, int xm) {
+                double acc = 0.0;
+                for(int d = 0; d < D; d++) {
+                    const index_t ip = (d == 0) ? b + xp : bp[d] + x;
+                    const index_t im = (d == 0) ? b + xm : bm[d] + x;
+                    acc += (double(a[ip]) - 2.0 * a[b + x] + a[im]) / (dx[d] * dx[d]);
+                }
+                o[b + x] = acc;
+            });
+        });
+    }
     
-    std::array<Field<D>, D> gradient(const Field<D> &f) const override {
-        std::array<Field<D>, D> g{Field<D>(f.g)};
-        for(int d = 1; d < D; ++d) g[d] = Field<D>(f.g);
-        for(int i = 0; i < f.g.size; i++) {
-            auto I = unflat<D>(i, f.g.n);
-            for(int d = 0; d < D; d++) {
-                auto Ip = I, Im = I;
-                Ip[d] = (I[d] + 1 == f.g.n[d]) ? 0 : I[d] + 1;
-                Im[d] = (I[d] == 0) ? f.g.n[d] - 1 : I[d] - 1;
-                g[d].a[i] = (f.a[flat<D>(Ip, f.g.n)] - f.a[flat<D>(Im, f.g.n)]) / (2.0 * f.g.dx[d]);
+    void gradient(const Field<D, T> &f, std::array<Field<D, T>, D> &g) const override {
+        if(order == 4) {
+            gradient_4th(f, g);
+            return;
+        }
+        const T *a = f.a.data();
+        const auto &dx = f.g.dx;
+        const auto &n = f.g.n;
+        fd::for_each_row<D>(n, [&](index_t b, const auto &bp, const auto &bm) {
+            fd::sweep_x(n, [&](int x, int xp, int xm) {
+                for(int d = 0; d < D; d++) {
+                    const index_t ip = (d == 0) ? b + xp : bp[d] + x;
+                    const index_t im = (d == 0) ? b + xm : bm[d] + x;
+                    g[d].a[b + x] = (double(a[ip]) - a[im]) / (2.0 * dx[d]);
+                }
+            });
+        });
+    }
+
+    void divergence(const std::array<Field<D, T>, D> &v, Field<D, T> &out) const override {
+        if(order == 4) {
+            divergence_4th(v, out);
+            return;
+        }
+        T *o = out.a.data();
+        const auto &dx = out.g.dx;
+        const auto &n = out.g.n;
+        fd::for_each_row<D>(n, [&](index_t b, const auto &bp, const auto &bm) {
+            fd::sweep_x(n, [&](int x, int xp, int xm) {
+                double acc = 0.0;
+                for(int d = 0; d < D; d++) {
+                    const index_t ip = (d == 0) ? b + xp : bp[d] + x;
+                    const index_t im = (d == 0) ? b + xm : bm[d] + x;
+                    acc += (double(v[d].a[ip]) - v[d].a[im]) / (2.0 * dx[d]);
+                }
+                o[b + x] = acc;
+            });
+        });
+    }
+
+    void div_M_grad(const Field<D, T> &M, const Field<D, T> &mu, Field<D, T> &out) const {
+        if(stencil != FDStencil::STANDARD) {
+            div_M_grad_isotropic(M, mu, out);
+            return;
+        }
+        if(order == 4) {
+            div_M_grad_4th(M, mu, out);
+            return;
+        }
+        const T *m = M.a.data();
+        const T *u = mu.a.data();
+        T *o = out.a.data();
+        const auto &dx = mu.g.dx;
+        const auto &n = mu.g.n;
+        fd::for_each_row<D>(n, [&](index_t b, const auto &bp, const auto &bm) {
+            fd::sweep_x(n, [&](int x, int xp, int xm) {
+                const index_t i = b + x;
+                double acc = 0.0;
+                for(int d = 0; d < D; d++) {
+                    // neighbors with periodic wrap
+                    const index_t ip = (d == 0) ? b + xp : bp[d] + x;
+                    const index_t im = (d == 0) ? b + xm : bm[d] + x;
+
+                    // mobility at faces
+                    const double M_p = 0.5 * (double(m[i]) + m[ip]);  // i+1/2 face
+                    const double M_m = 0.5 * (double(m[i]) + m[im]);  // i-1/2 face
+                    // face gradients of mu
+                    const double dmu_p = (double(u[ip]) - u[i]) / dx[d];
+                    const double dmu_m = (double(u[i])  - u[im]) / dx[d];
+
+                    // fluxes at faces: J = M ∇μ  (no minus sign here)
+                    const double Jp = M_p * dmu_p;
+                    const double Jm = M_m * dmu_m;
+
+                    // divergence contribution
+                    acc += (Jp - Jm) / dx[d];
+                }
+                o[i] = acc;
+            });
+        });
+    }
+
+   private:
+    // flat index of the site k sites away from the site x of the current row along d
+    template <class RS, class XS>
+    static index_t shifted(const RS &rs, const XS &xs, int x, int d, int k) {
+        constexpr int R = (RS::W - 1) / 2;
+        if(d == 0) {
+            return rs(0, 0) + xs[k + R];
+        }
+        return ((d == 1) ? rs(k, 0) : rs(0, k)) + x;
+    }
+
+    // ---- fourth order ----
+
+    void laplacian_4th(const Field<D, T> &f, Field<D, T> &out) const {
+        const T *a = f.a.data();
+        T *o = out.a.data();
+        const auto &dx = f.g.dx;
+        const auto &n = f.g.n;
+        fd::for_each_row_r<D, 2>(n, [&](const auto &rs) {
+            fd::sweep_x_r<2>(n, [&](int x, const auto &xs) {
+                auto at = [&](int d, int k) { return a[shifted(rs, xs, x, d, k)]; };
+                double acc = 0.0;
+                for(int d = 0; d < D; d++) {
+                    acc += (-double(at(d, 2)) + 16.0 * at(d, 1) - 30.0 * at(d, 0) + 16.0 * at(d, -1) - at(d, -2)) / (12.0 * dx[d] * dx[d]);
+                }
+                o[rs(0, 0) + x] = acc;
+            });
+        });
+    }
+
+    void gradient_4th(const Field<D, T> &f, std::array<Field<D, T>, D> &g) const {
+        const T *a = f.a.data();
+        const auto &dx = f.g.dx;
+        const auto &n = f.g.n;
+        fd::for_each_row_r<D, 2>(n, [&](const auto &rs) {
+            fd::sweep_x_r<2>(n, [&](int x, const auto &xs) {
+                auto at = [&](int d, int k) { return a[shifted(rs, xs, x, d, k)]; };
+                for(int d = 0; d < D; d++) {
+                    g[d].a[rs(0, 0) + x] = (double(at(d, -2)) - 8.0 * at(d, -1) + 8.0 * at(d, 1) - at(d, 2)) / (12.0 * dx[d]);
+                }
+            });
+        });
+    }
+
+    void divergence_4th(const std::array<Field<D, T>, D> &v, Field<D, T> &out) const {
+        T *o = out.a.data();
+        const auto &dx = out.g.dx;
+        const auto &n = out.g.n;
+        fd::for_each_row_r<D, 2>(n, [&](const auto &rs) {
+            fd::sweep_x_r<2>(n, [&](int x, const auto &xs) {
+                double acc = 0.0;
+                for(int d = 0; d < D; d++) {
+                    // taken out of the lambda, so that the compiler can see that d < D
+                    const T *vd = v[d].a.data();
+                    const double h = dx[d];
+                    auto at = [&](int k) { return vd[shifted(rs, xs, x, d, k)]; };
+                    acc += (double(at(-2)) - 8.0 * at(-1) + 8.0 * at(1) - at(2)) / (12.0 * h);
+                }
+                o[rs(0, 0) + x] = acc;
+            });
+        });
+    }
+
+    // Conservative: fourth-order fluxes are computed at the faces at ±1/2 and ±3/2 (mobility interpolated
+    // and μ differentiated with four points each) and then differentiated with the staggered
+    // fourth-order stencil
+    void div_M_grad_4th(const Field<D, T> &M, const Field<D, T> &mu, Field<D, T> &out) const {
+        const T *m = M.a.data();
+        const T *u = mu.a.data();
+        T *o = out.a.data();
+        const auto &dx = mu.g.dx;
+        const auto &n = mu.g.n;
+        fd::for_each_row_r<D, 3>(n, [&](const auto &rs) {
+            fd::sweep_x_r<3>(n, [&](int x, const auto &xs) {
+                double acc = 0.0;
+                for(int d = 0; d < D; d++) {
+                    const double h = dx[d];
+                    auto M_at = [&](int k) { return m[shifted(rs, xs, x, d, k)]; };
+                    auto mu_at = [&](int k) { return u[shifted(rs, xs, x, d, k)]; };
+                    // flux through the face between the sites s and s + 1
+                    auto J = [&](int s) {
+                        const double M_f = (-double(M_at(s - 1)) + 9.0 * M_at(s) + 9.0 * M_at(s + 1) - M_at(s + 2)) / 16.0;
+                        const double dmu_f = (double(mu_at(s - 1)) - 27.0 * mu_at(s) + 27.0 * mu_at(s + 1) - mu_at(s + 2)) / (24.0 * h);
+                        return M_f * dmu_f;
+                    };
+                    acc += (J(-2) - 27.0 * J(-1) + 27.0 * J(0) - J(1)) / (24.0 * h);
+                }
+                o[rs(0, 0) + x] = acc;
+            });
+        });
+    }
+
+    // ---- isotropic ----
+
+    // Every site of the unit cube around the current one contributes with a weight that depends only
+    // on its distance, i.e. on the number m of non-zero components of its offset:
+    //   2D, 9 points:   (4 Σ_nn + Σ_diagonal - 20 f) / 6h²
+    //   3D, 19 points:  (2 Σ_nn + Σ_edge - 24 f) / 6h²
+    //   3D, 27 points:  (14 Σ_nn + 3 Σ_edge + Σ_corner - 128 f) / 30h²
+    // The weights returned here are indexed by m and include the normalisation (but not h²)
+    std::array<double, 4> isotropic_weights() const {
+        if constexpr (D == 1) {
+            return {-2.0, 1.0, 0.0, 0.0};
+        }
+        else if constexpr (D == 2) {
+            return {-20.0 / 6.0, 4.0 / 6.0, 1.0 / 6.0, 0.0};
+        }
+        else {
+            if(stencil == FDStencil::ISOTROPIC_27) {
+                return {-128.0 / 30.0, 14.0 / 30.0, 3.0 / 30.0, 1.0 / 30.0};
             }
+            return {-24.0 / 6.0, 2.0 / 6.0, 1.0 / 6.0, 0.0};
         }
-        return g;
     }
 
-    Field<D> divergence(const std::array<Field<D>, D> &v) const override {
-        Field<D> out(v[0].g);
-        for(int i = 0; i < out.g.size; i++) {
-            auto I = unflat<D>(i, out.g.n);
-            double acc = 0.0;
-            for(int d = 0; d < D; d++) {
-                auto Ip = I, Im = I;
-                Ip[d] = (I[d] + 1 == out.g.n[d]) ? 0 : I[d] + 1;
-                Im[d] = (I[d] == 0) ? out.g.n[d] - 1 : I[d] - 1;
-                acc += (v[d].a[flat<D>(Ip, out.g.n)] - v[d].a[flat<D>(Im, out.g.n)]) / (2.0 * out.g.dx[d]);
+    // call fn(ox, oy, oz, m) for each of the 3^D offsets of the unit cube
+    template <class F>
+    static void for_each_cube_offset(F &&fn) {
+        constexpr int RY = (D >= 2) ? 1 : 0;
+        constexpr int RZ = (D >= 3) ? 1 : 0;
+        for(int oz = -RZ; oz <= RZ; oz++) {
+            for(int oy = -RY; oy <= RY; oy++) {
+                for(int ox = -1; ox <= 1; ox++) {
+                    fn(ox, oy, oz, (ox != 0) + (oy != 0) + (oz != 0));
+                }
             }
-            out.a[i] = acc;
         }
-        return out;
     }
 
-    // Divergence of M * gradient of mu, where M is a scalar field
-    Field<D> div_M_grad(const Field<D> &M, const Field<D> &mu) const {
-        Field<D> out(mu.g);
-        out.fill(0.0);
-
-        for(int i = 0; i < mu.g.size; i++) {
-            auto I = unflat<D>(i, mu.g.n);
-            double acc = 0.0;
-
-            for(int d = 0; d < D; d++) {
-                // neighbors with periodic wrap
-                auto Ip = I, Im = I;
-                Ip[d] = (I[d] + 1 == mu.g.n[d]) ? 0 : I[d] + 1;
-                Im[d] = (I[d] == 0) ? mu.g.n[d] - 1 : I[d] - 1;
-                const int ip = flat<D>(Ip, mu.g.n);
-                const int im = flat<D>(Im, mu.g.n);
-
-                const double dx = mu.g.dx[d];
-
-                // mobility at faces
-                const double M_p = 0.5 * (M.a[i] + M.a[ip]);  // i+1/2 face
-                const double M_m = 0.5 * (M.a[i] + M.a[im]);  // i-1/2 face
-                // face gradients of mu
-                const double dmu_p = (mu.a[ip] - mu.a[i]) / dx;
-                const double dmu_m = (mu.a[i]  - mu.a[im]) / dx;
-
-                // fluxes at faces: J = M ∇μ  (no minus sign here)
-                const double Jp = M_p * dmu_p;
-                const double Jm = M_m * dmu_m;
-
-                // divergence contribution
-                acc += (Jp - Jm) / dx;
+    static double isotropic_h2(const Grid<D> &g) {
+        for(int d = 1; d < D; d++) {
+            if(std::abs(g.dx[d] - g.dx[0]) > 1e-12 * g.dx[0]) {
+                throw std::runtime_error("Isotropic stencils require the same grid spacing along all the dimensions");
             }
-            out.a[i] = acc;
         }
-        return out;
+        return g.dx[0] * g.dx[0];
+    }
+
+    void laplacian_isotropic(const Field<D, T> &f, Field<D, T> &out) const {
+        const double h2 = isotropic_h2(f.g);
+        const auto w = isotropic_weights();
+        const T *a = f.a.data();
+        T *o = out.a.data();
+        const auto &n = f.g.n;
+        fd::for_each_row_r<D, 1>(n, [&](const auto &rs) {
+            fd::sweep_x_r<1>(n, [&](int x, const auto &xs) {
+                double acc = 0.0;
+                for_each_cube_offset([&](int ox, int oy, int oz, int m) {
+                    acc += w[m] * a[rs(oy, oz) + xs[ox + 1]];
+                });
+                o[rs(0, 0) + x] = acc / h2;
+            });
+        });
+    }
+
+    // Conservative: each neighbour j exchanges with the current site i a flux w_m M_ij (μ_j - μ_i), with
+    // M_ij = (M_i + M_j) / 2, so that the isotropic laplacian is recovered for constant M
+    void div_M_grad_isotropic(const Field<D, T> &M, const Field<D, T> &mu, Field<D, T> &out) const {
+        const double h2 = isotropic_h2(mu.g);
+        const auto w = isotropic_weights();
+        const T *m = M.a.data();
+        const T *u = mu.a.data();
+        T *o = out.a.data();
+        const auto &n = mu.g.n;
+        fd::for_each_row_r<D, 1>(n, [&](const auto &rs) {
+            fd::sweep_x_r<1>(n, [&](int x, const auto &xs) {
+                const index_t i = rs(0, 0) + x;
+                double acc = 0.0;
+                for_each_cube_offset([&](int ox, int oy, int oz, int nz) {
+                    if(nz > 0) {
+                        const index_t j = rs(oy, oz) + xs[ox + 1];
+                        acc += w[nz] * 0.5 * (double(m[i]) + m[j]) * (double(u[j]) - u[i]);
+                    }
+                });
+                o[i] = acc / h2;
+            });
+        });
     }
 };
 
@@ -0,0 +1,178 @@
+#pragma once
+#include <algorithm>
+#include <array>
+
+#include "../core/grid.hpp"
+
+namespace circa::fd {
+
+// Sizes of the y-z tiles used to traverse 3D grids: all the rows of a tile are visited before
+// moving to the next one, so that the planes above and below a row are still in cache when they
+// are needed as its z neighbours. A size of 0 means no tiling along that direction. Set at startup
+// (see fd_autotune.hpp)
+struct Tile {
+    int y = 0;
+    int z = 0;
+};
+
+inline Tile& active_tile() {
+    static Tile tile;
+    return tile;
+}
+
+// Call row(base, bp, bm) for each row of points along x. base is the flat index of the first point
+// of the row, while bp[d] and bm[d] (d >= 1) are the flat indices of the first points of the rows
+// that are the periodic neighbours of this one along d
+template <int D, class E, class R>
+inline void for_each_row(const E& n, R&& row) {
+    std::array<index_t, D> bp{}, bm{};
+    if constexpr (D == 1) {
+        row(index_t(0), bp, bm);
+    }
+    else if constexpr (D == 2) {
+        const index_t nx = n[0];
+        for(int y = 0; y < n[1]; y++) {
+            bp[1] = ((y + 1 == n[1]) ? 0 : y + 1) * nx;
+            bm[1] = ((y == 0) ? n[1] - 1 : y - 1) * nx;
+            row(y * nx, bp, bm);
+        }
+    }
+    else {
+        static_assert(D == 3, "Only D = 1, 2, 3 are supported");
+        const index_t nx = n[0];
+        const index_t nxy = nx * n[1];
+        const Tile tile = active_tile();
+        const int ty = (tile.y > 0) ? tile.y : n[1];
+        const int tz = (tile.z > 0) ? tile.z : n[2];
+        for(int z0 = 0; z0 < n[2]; z0 += tz) {
+            const int z1 = std::min(z0 + tz, n[2]);
+            for(int y0 = 0; y0 < n[1]; y0 += ty) {
+                const int y1 = std::min(y0 + ty, n[1]);
+                for(int z = z0; z < z1; z++) {
+                    const index_t zp = ((z + 1 == n[2]) ? 0 : z + 1) * nxy;
+                    const index_t zm = ((z == 0) ? n[2] - 1 : z - 1) * nxy;
+                    for(int y = y0; y < y1; y++) {
+                        const index_t yp = ((y + 1 == n[1]) ? 0 : y + 1) * nx;
+                        const index_t ym = ((y == 0) ? n[1] - 1 : y - 1) * nx;
+                        const index_t base = z * nxy + y * nx;
+                        bp[1] = z * nxy + yp;
+                        bm[1] = z * nxy + ym;
+                        bp[2] = zp + y * nx;
+                        bm[2] = zm + y * nx;
+                        row(base, bp, bm);
+                    }
+                }
+            }
+        }
+    }
+}
+
+// Call pt(x, x + 1, x - 1) along a row of n[0] points, with periodic wrap. Only the first and the
+// last points wrap around, so that the loop over the interior is branch-free and can be vectorised
+template <class E, class P>
+inline void sweep_x(const E& n, P&& pt) {
+    const int nx = n[0];
+    if(nx == 1) {
+        pt(0, 0, 0);
+        return;
+    }
+    pt(0, 1, nx - 1);
+    for(int x = 1; x < nx - 1; x++) {
+        pt(x, x + 1, x - 1);
+    }
+    pt(nx - 1, 0, nx - 2);
+}
+
+// Flat indices of the first points of the rows that are within R rows from the current one along
+// y and z, indexed by the offsets (dy, dz), with |dy|, |dz| <= R (dz = 0 in 2D, dy = dz = 0 in 1D)
+template <int D, int R>
+struct RowStencil {
+    static constexpr int W = 2 * R + 1;
+    static constexpr int NY = (D >= 2) ? W : 1;
+    static constexpr int NZ = (D >= 3) ? W : 1;
+    std::array<index_t, NY * NZ> b{};
+
+    index_t operator()(int dy, int dz = 0) const {
+        return b[((NZ > 1) ? (dz + R) * NY : 0) + ((NY > 1) ? dy + R : 0)];
+    }
+};
+
+// Same as for_each_row, but row(rs) gets the indices of all the rows within a distance R (as a
+// RowStencil), which is what wider and non-axial stencils need
+template <int D, int R, class E, class F>
+inline void for_each_row_r(const E& n, F&& row) {
+    RowStencil<D, R> rs;
+    auto wrap = [](int i, int m) {
+        return ((i % m) + m) % m;
+    };
+    if constexpr (D == 1) {
+        row(rs);
+    }
+    else if constexpr (D == 2) {
+        const index_t nx = n[0];
+        for(int y = 0; y < n[1]; y++) {
+            for(int dy = -R; dy <= R; dy++) {
+                rs.b[dy + R] = wrap(y + dy, n[1]) * nx;
+            }
+            row(rs);
+        }
+    }
+    else {
+        static_assert(D == 3, "Only D = 1, 2, 3 are supported");
+        const index_t nx = n[0];
+        const index_t nxy = nx * n[1];
+        const Tile tile = active_tile();
+        const int ty = (tile.y > 0) ? tile.y : n[1];
+        const int tz = (tile.z > 0) ? tile.z : n[2];
+        for(int z0 = 0; z0 < n[2]; z0 += tz) {
+            const int z1 = std::min(z0 + tz, n[2]);
+            for(int y0 = 0; y0 < n[1]; y0 += ty) {
+                const int y1 = std::min(y0 + ty, n[1]);
+                for(int z = z0; z < z1; z++) {
+                    for(int y = y0; y < y1; y++) {
+                        for(int dz = -R; dz <= R; dz++) {
+                            for(int dy = -R; dy <= R; dy++) {
+                                rs.b[(dz + R) * (2 * R + 1) + dy + R] = wrap(z + dz, n[2]) * nxy + wrap(y + dy, n[1]) * nx;
+                            }
+                        }
+                        row(rs);
+                    }
+                }
+            }
+        }
+    }
+}
+
+// Call pt(x, xs) along a row, where xs[k] is x + k - R with periodic wrap (k = 0, ..., 2R). As in
+// sweep_x, the interior of the row is handled by a branch-free loop
+template <int R, class E, class P>
+inline void sweep_x_r(const E& n, P&& pt) {
+    const int nx = n[0];
+    std::array<int, 2 * R + 1> xs;
+    auto wrapped = [&](int x) {
+        for(int k = 0; k <= 2 * R; k++) {
+            xs[k] = ((x + k - R) % nx + nx) % nx;
+        }
+        pt(x, xs);
+    };
+    if(nx <= 2 * R) {
+        for(int x = 0; x < nx; x++) {
+            wrapped(x);
+        }
+        return;
+    }
+    for(int x = 0; x < R; x++) {
+        wrapped(x);
+    }
+    for(int x = R; x < nx - R; x++) {
+        for(int k = 0; k <= 2 * R; k++) {
+            xs[k] = x + k - R;
+        }
+        pt(x, xs);
+    }
+    for(int x = nx - R; x < nx; x++) {
+        wrapped(x);
+    }
+}
+
+}  // namespace circa::fd
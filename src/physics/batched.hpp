@@ -0,0 +1,65 @@
+#pragma once
+#include <type_traits>
+#include <utility>
+
+#include "../core/field_store.hpp"
+
+namespace circa {
+
+// Array-level evaluation of free energies and mobilities. Models can provide
+//   void mu(const real* in, real* out, index_t n) const                                  // free energies
+//   void mobility(const FieldStore<D>& S, index_t begin, index_t n, real* out) const         // mobilities
+// to evaluate n values at once (which lets the compiler vectorise the transcendental functions and
+// hoist the field lookups out of the loop). Models that only offer the scalar interface are
+// evaluated one value at a time through the adapters below.
+
+template <typename FE>
+struct has_batched_mu {
+   private:
+    template <typename U>
+    static auto test(int) -> decltype(std::declval<const U&>().mu((const real*)nullptr, (real*)nullptr, 0), std::true_type{});
+    template <typename>
+    static std::false_type test(...);
+
+   public:
+    static constexpr bool value = decltype(test<FE>(0))::value;
+};
+
+template <typename MOB, int D>
+struct has_batched_mobility {
+   private:
+    template <typename U>
+    static auto test(int) -> decltype(std::declval<const U&>().mobility(std::declval<const FieldStore<D>&>(), 0, 0, (real*)nullptr), std::true_type{});
+    template <typename>
+    static std::false_type test(...);
+
+   public:
+    static constexpr bool value = decltype(test<MOB>(0))::value;
+};
+
+template <class FE>
+inline void batch_mu(const FE& fe, const real* in, real* out, index_t n) {
+    if constexpr (has_batched_mu<FE>::value) {
+        fe.mu(in, out, n);
+    }
+    else {
+        for(index_t k = 0; k < n; k++) {
+            out[k] = fe.mu(in[k]);
+        }
+    }
+}
+
+// evaluates the mobility on the sites [begin, begin + n) and stores it in out[0 ... n - 1]
+template <int D, class MOB>
+inline void batch_mobility(const MOB& mob, const FieldStore<D>& S, index_t begin, index_t n, real* out) {
+    if constexpr (has_batched_mobility<MOB, D>::value) {
+        mob.mobility(S, begin, n, out);
+    }
+    else {
+        for(index_t k = 0; k < n; k++) {
+            out[k] = mob(begin + k, S);
+        }
+    }
+}
+
+}  // namespace circa
@@ -16,9 +16,19 @@ struct FE_AC_Gel {
     }
 
     inline double dfdc(double c, double driver) const {
-        double phi = (rescale_OP) ? (driver + 1.0) / 2.0 : driver;
-        double g = (p_gel * phi - critical_OP) / (1.0 - critical_OP);
+        double g = gel_fraction(driver);
         return M_c * (c * c - g * c);
     }
+
+    // the density whose derivative is dfdc
+    inline double f(double c, double driver) const {
+        double g = gel_fraction(driver);
+        return M_c * (c * c * c / 3.0 - 0.5 * g * c * c);
+    }
+
+    inline double gel_fraction(double driver) const {
+        double phi = (rescale_OP) ? (driver + 1.0) / 2.0 : driver;
+        return (p_gel * phi - critical_OP) / (1.0 - critical_OP);
+    }
 };
 }  // namespace circa
@@ -1,4 +1,5 @@
 #pragma once
+#include "../core/field.hpp"
 #include "../util/toml.hpp"
 
 namespace circa {
@@ -17,6 +18,13 @@ struct FE_CH_Landau {
     inline double mu(double u) const { 
         return -eps * u + u * u * u;
     }
+
+    inline void mu(const real* u, real* out, index_t n) const {
+        for(index_t k = 0; k < n; k++) {
+            const double x = u[k];
+            out[k] = -eps * x + x * x * x;
+        }
+    }
 };
 
 }  // namespace circa
@@ -1,17 +1,23 @@
 #pragma once
+#include <cmath>
+
+#include "../core/field.hpp"
 #include "../util/toml.hpp"
+#include "../util/vmath.hpp"
 
 namespace circa {
 
 struct FE_CH_Wertheim {
     double B2, delta, two_valence_delta;
     int valence;
+    vmath::Accuracy math;  // used by the batched functions
 
     FE_CH_Wertheim(const toml::table &fe_tbl) {
         B2 = *value_or_die<double>(fe_tbl, "B2");
         delta = *value_or_die<double>(fe_tbl, "delta");
         valence = *value_or_die<double>(fe_tbl, "valence");
         two_valence_delta = 2.0 * valence * delta;
+        math = vmath::accuracy_from_string(value_or<std::string>(fe_tbl, "math", "exact"));
     }
 
     inline double X(double rho) const {
@@ -32,6 +38,19 @@ struct FE_CH_Wertheim {
         return der_f_ref + der_f_bond;
     }
 
+    // same as above, written without branches so that the loop (and its log's) can be vectorised
+    inline void mu(const real* rho, real* out, index_t n) const {
+        vmath::dispatch(math, [&](auto A) {
+            constexpr vmath::Accuracy acc = decltype(A)::value;
+            for(index_t k = 0; k < n; k++) {
+                const double r = rho[k];
+                const double der_f_ref = vmath::log<acc>(r) + 2 * B2 * r;
+                const double der_f_bond = valence * vmath::log<acc>(X(r));
+                out[k] = der_f_ref + ((r > 0.) ? der_f_bond : 0.0);
+            }
+        });
+    }
+
     inline double dmu_drho(double rho) const {
         double my_X = X(rho);
         double d2f_ref = 1.0 / rho + 2.0 * B2;
@@ -1,8 +1,13 @@
 #pragma once
+#include <algorithm>
 #include <cmath>
 #include <string>
+#include <type_traits>
 
 #include "../core/field_store.hpp"
+#include "../util/toml.hpp"
+#include "tabulated.hpp"
+#include "../util/vmath.hpp"
 
 namespace circa {
 
@@ -10,19 +15,33 @@ template <int D>
 struct MobConst {
     double M0 = 1.0;
 
-    inline double operator()(int /*i*/, const FieldStore<D>& /*S*/) const { 
+    inline double operator()(index_t /*i*/, const FieldStore<D>& /*S*/) const { 
         return M0;
     }
+
+    inline void mobility(const FieldStore<D>& /*S*/, index_t /*begin*/, index_t n, real* out) const {
+        std::fill(out, out + n, M0);
+    }
 };
 
 template <int D>
 struct MobExpOfField {
     std::string field;
     double c0;
+    vmath::Accuracy math = vmath::Accuracy::EXACT;  // used by the batched function
 
-    inline double operator()(int i, const FieldStore<D>& S) const { 
+    inline double operator()(index_t i, const FieldStore<D>& S) const { 
         return std::exp(-S.get(field).a[i] / c0);
     }
+
+    inline void mobility(const FieldStore<D>& S, index_t begin, index_t n, real* out) const {
+        const real* c = S.get(field).a.data() + begin;
+        vmath::dispatch(math, [&](auto A) {
+            for(index_t k = 0; k < n; k++) {
+                out[k] = vmath::exp<decltype(A)::value>(-c[k] / c0);
+            }
+        });
+    }
 };
 
 // Mobility model based on Wertheim theory
@@ -31,20 +50,57 @@ template<int D>
 struct MobWertheimAuto {
     double D0 = 1.0;
     std::string field = "c";
+    const toml::table* tabulate = nullptr;  // [tabulate] options, if any
 };
 
-// And then the actual mobility model that uses a FE_CH_Wertheim instance
+// And then the actual mobility model that uses (a copy of) a FE_CH_Wertheim instance, or of its
+// tabulated version, in which case dmu/drho is taken from the table of the free energy
 template<int D, class FE>
 struct MobWertheimBound {
     MobWertheimAuto<D> cfg;
-    const FE* fe = nullptr;
-
-    inline double operator()(int i, const FieldStore<D>& S) const {
-        const double rho = S.get(cfg.field).a[i];
-        const double dmu_drho = fe->dmu_drho(rho);
-        const double X = fe->X(rho);
-        return cfg.D0 * std::pow(X, fe->valence) / dmu_drho;
-    }   
+    FE fe;
+
+    inline double operator()(index_t i, const FieldStore<D>& S) const {
+        return of(S.get(cfg.field).a[i]);
+    }
+
+    // the mobility as a function of the local density
+    inline double of(double rho) const {
+        const double dmu_drho = fe.dmu_drho(rho);
+        const double X = model().X(rho);
+        return cfg.D0 * std::pow(X, model().valence) / dmu_drho;
+    }
+
+    const std::string& field_name() const {
+        return cfg.field;
+    }
+
+    inline void mobility(const FieldStore<D>& S, index_t begin, index_t n, real* out) const {
+        const real* rho = S.get(cfg.field).a.data() + begin;
+        const auto& w = model();
+        if constexpr (std::is_same_v<std::decay_t<decltype(w)>, FE>) {
+            // X(rho) is evaluated only once per site
+            for(index_t k = 0; k < n; k++) {
+                const double r = rho[k];
+                const double X = w.X(r);
+                const double d2f_ref = 1.0 / r + 2.0 * w.B2;
+                const double d2f_bond = w.valence * (X - 1.0) / ((2.0 - X) * r);
+                const double dmu_drho = d2f_ref + ((r > 0.) ? d2f_bond : 0.0);
+                out[k] = cfg.D0 * vmath::powi(X, w.valence) / dmu_drho;
+            }
+        }
+        else {
+            fe.dmu_drho(rho, out, n);
+            for(index_t k = 0; k < n; k++) {
+                out[k] = cfg.D0 * vmath::powi(w.X(rho[k]), w.valence) / out[k];
+            }
+        }
+    }
+
+   private:
+    const auto& model() const {
+        return analytic_of(fe);
+    }
 };
 
 
@@ -1,24 +1,24 @@
 #pragma once
-#include <vector>
+#include <array>
 
 #include "../core/field_store.hpp"
 
 namespace circa {
 
 // Diagonal, constant M_i
-template <int D>
+template <int D, int N>
 struct MobilityDiagConst {
-    std::vector<double> M;  // size N
-    inline double M_i(int i_species, int /*idx*/, const FieldStore<D>& /*S*/) const {
+    std::array<double, N> M{};
+    inline double M_i(int i_species, index_t /*idx*/, const FieldStore<D>& /*S*/) const {
         return M[i_species];
     }
 };
 
 // Full constant matrix M_{iβ}
-template <int D>
+template <int D, int N>
 struct MobilityFullConst {
-    std::vector<std::vector<double>> M;  // size N x N
-    inline double M_ibeta(int i, int b, int /*idx*/, const FieldStore<D>& /*S*/) const {
+    std::array<std::array<double, N>, N> M{};
+    inline double M_ibeta(int i, int b, index_t /*idx*/, const FieldStore<D>& /*S*/) const {
         return M[i][b];
     }
 };
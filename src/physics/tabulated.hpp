@@ -0,0 +1,258 @@
+#pragma once
+#include <algorithm>
+#include <cmath>
+#include <functional>
+#include <string>
+#include <vector>
+
+#include "../core/field_store.hpp"
+#include "../util/math.hpp"
+#include "../util/toml.hpp"
+
+namespace circa {
+
+// [tabulate] options shared by all the tabulated models
+struct TableOptions {
+    double x_min, x_max;
+    int points;
+    // "hermite": node slopes from the exact derivative (or from an accurate finite difference when the
+    //            derivative is not known analytically)
+    // "cubic": node slopes estimated from the tabulated values (Catmull-Rom spline)
+    bool hermite;
+
+    TableOptions(const toml::table& tbl) {
+        auto range = tbl["range"].as_array();
+        if(!range) {
+            throw std::runtime_error("[tabulate] expects a 'range = [min, max]' array");
+        }
+        auto r = array_from_toml<double, 2>(*range, "range");
+        x_min = r[0];
+        x_max = r[1];
+        points = value_or<int>(tbl, "points", 4096);
+        const std::string interp = value_or<std::string>(tbl, "interpolation", "hermite");
+        if(interp != "hermite" && interp != "cubic") {
+            throw std::runtime_error("[tabulate] unknown interpolation '" + interp + "' (should be 'hermite' or 'cubic')");
+        }
+        hermite = (interp == "hermite");
+        if(!(x_max > x_min) || points < 3) {
+            throw std::runtime_error("[tabulate] expects max > min and at least 3 points");
+        }
+    }
+};
+
+// Piecewise-cubic interpolation of a scalar function on uniformly-spaced nodes. The four coefficients
+// of each interval are stored next to each other, so that a lookup touches a single cache line.
+struct CubicTable {
+    using Fn = std::function<double(double)>;
+
+    std::string name;
+    double x_min = 0.0, x_max = 0.0, h = 0.0, inv_h = 0.0;
+    int n_intervals = 0;
+    std::vector<double> coeffs;
+
+    CubicTable() = default;
+
+    // df may be empty, in which case the hermite slopes are computed by finite differences. The values
+    // and slopes at the nodes must be finite, i.e. the range must lie within the domain of f
+    CubicTable(const std::string& name, const Fn& f, const Fn& df, const TableOptions& opts) : name(name), x_min(opts.x_min), x_max(opts.x_max) {
+        const int n = opts.points;
+        n_intervals = n - 1;
+        h = (x_max - x_min) / n_intervals;
+        inv_h = 1.0 / h;
+
+        std::vector<double> y(n), m(n);
+        for(int k = 0; k < n; k++) {
+            y[k] = f(node(k));
+        }
+        for(int k = 0; k < n; k++) {
+            if(opts.hermite) {
+                if(df) {
+                    m[k] = df(node(k));
+                }
+                else {
+                    // five-point stencil
+                    const double x = node(k), s = 1e-3 * h;
+                    m[k] = (f(x - 2 * s) - 8 * f(x - s) + 8 * f(x + s) - f(x + 2 * s)) / (12 * s);
+                }
+            }
+            else if(k == 0) {
+                m[k] = (-3 * y[0] + 4 * y[1] - y[2]) / (2 * h);
+            }
+            else if(k == n - 1) {
+                m[k] = (3 * y[n - 1] - 4 * y[n - 2] + y[n - 3]) / (2 * h);
+            }
+            else {
+                m[k] = (y[k + 1] - y[k - 1]) / (2 * h);
+            }
+        }
+        for(int k = 0; k < n; k++) {
+            if(!util::safe_isfinite(y[k]) || !util::safe_isfinite(m[k])) {
+                throw std::runtime_error(fmt::format("[tabulate] the {} is not finite at {}: the range [{}, {}] should lie within the domain of the model", name, node(k), x_min, x_max));
+            }
+        }
+
+        // p(t) = c0 + c1 t + c2 t^2 + c3 t^3, with t = (x - x_k) / h
+        coeffs.resize(4 * n_intervals);
+        for(int k = 0; k < n_intervals; k++) {
+            double* c = coeffs.data() + 4 * k;
+            c[0] = y[k];
+            c[1] = h * m[k];
+            c[2] = 3 * (y[k + 1] - y[k]) - h * (2 * m[k] + m[k + 1]);
+            c[3] = 2 * (y[k] - y[k + 1]) + h * (m[k] + m[k + 1]);
+        }
+    }
+
+    double node(int k) const {
+        return x_min + k * h;
+    }
+
+    bool in_range(double x) const {
+        return x >= x_min && x <= x_max;
+    }
+
+    // the interval of u = (x - x_min) / h. u is clamped before the conversion, which would be undefined
+    // for values that do not fit in an int (and for NaNs, which end up in the first interval)
+    inline int interval(double u) const {
+        const double last = n_intervals - 1;
+        return (int)((u > 0.0) ? ((u < last) ? u : last) : 0.0);
+    }
+
+    // x should be in range: values outside are extrapolated from the first/last interval
+    inline double operator()(double x) const {
+        const double u = (x - x_min) * inv_h;
+        const int k = interval(u);
+        const double t = u - k;
+        const double* c = coeffs.data() + 4 * k;
+        return ((c[3] * t + c[2]) * t + c[1]) * t + c[0];
+    }
+
+    // branch-free loop that the compiler can vectorise (with gathers)
+    inline void operator()(const real* x, real* out, index_t n) const {
+        const double* cf = coeffs.data();
+        for(index_t i = 0; i < n; i++) {
+            const double u = (x[i] - x_min) * inv_h;
+            const int k = interval(u);
+            const double t = u - k;
+            const double* c = cf + 4 * k;
+            out[i] = ((c[3] * t + c[2]) * t + c[1]) * t + c[0];
+        }
+    }
+
+    // largest absolute and relative interpolation errors, sampled between the nodes
+    std::pair<double, double> accuracy(const Fn& f) const {
+        double max_abs = 0.0, max_rel = 0.0;
+        for(int k = 0; k < n_intervals; k++) {
+            for(double t : {0.25, 0.5, 0.75}) {
+                const double x = x_min + (k + t) * h;
+                const double exact = f(x);
+                const double err = std::abs((*this)(x) - exact);
+                max_abs = std::max(max_abs, err);
+                if(exact != 0.0) {
+                    max_rel = std::max(max_rel, err / std::abs(exact));
+                }
+            }
+        }
+        return {max_abs, max_rel};
+    }
+
+    void report(const Fn& f) const {
+        auto [abs_err, rel_err] = accuracy(f);
+        CIRCA_INFO("Tabulated {} on [{}, {}] with {} points: max absolute error = {:.3e}, max relative error = {:.3e}", name, x_min, x_max, n_intervals + 1, abs_err, rel_err);
+    }
+};
+
+// Replaces the analytic bulk free energy, chemical potential and its derivative of a CH free energy
+// with tables. Outside the tabulated range the analytic functions are used.
+template <class FE>
+struct FE_CH_Tabulated {
+    FE analytic;
+    CubicTable bulk_t, mu_t, dmu_drho_t;
+
+    FE_CH_Tabulated(const FE& fe, const toml::table& tab_tbl) : analytic(fe) {
+        TableOptions opts(tab_tbl);
+        auto bulk = [this](double x) { return analytic.bulk(x); };
+        auto mu = [this](double x) { return analytic.mu(x); };
+        auto dmu_drho = [this](double x) { return analytic.dmu_drho(x); };
+
+        bulk_t = CubicTable("bulk free energy", bulk, mu, opts);
+        mu_t = CubicTable("chemical potential", mu, dmu_drho, opts);
+        dmu_drho_t = CubicTable("dmu/drho", dmu_drho, nullptr, opts);
+
+        bulk_t.report(bulk);
+        mu_t.report(mu);
+        dmu_drho_t.report(dmu_drho);
+    }
+
+    inline double bulk(double u) const {
+        return bulk_t.in_range(u) ? bulk_t(u) : analytic.bulk(u);
+    }
+
+    inline double mu(double u) const {
+        return mu_t.in_range(u) ? mu_t(u) : analytic.mu(u);
+    }
+
+    inline void mu(const real* u, real* out, index_t n) const {
+        mu_t(u, out, n);
+        for(index_t k = 0; k < n; k++) {
+            if(!mu_t.in_range(u[k])) {
+                out[k] = analytic.mu(u[k]);
+            }
+        }
+    }
+
+    inline double dmu_drho(double u) const {
+        return dmu_drho_t.in_range(u) ? dmu_drho_t(u) : analytic.dmu_drho(u);
+    }
+
+    inline void dmu_drho(const real* u, real* out, index_t n) const {
+        dmu_drho_t(u, out, n);
+        for(index_t k = 0; k < n; k++) {
+            if(!dmu_drho_t.in_range(u[k])) {
+                out[k] = analytic.dmu_drho(u[k]);
+            }
+        }
+    }
+};
+
+// the analytic model behind a (possibly) tabulated free energy
+template <class FE>
+const FE& analytic_of(const FE& fe) {
+    return fe;
+}
+
+template <class FE>
+const FE& analytic_of(const FE_CH_Tabulated<FE>& fe) {
+    return fe.analytic;
+}
+
+// Tabulated version of a mobility that depends only on the local value of a single field. MOB must
+// offer field_name() and of(double value)
+template <int D, class MOB>
+struct MobTabulated {
+    MOB analytic;
+    std::string field;
+    CubicTable table;
+
+    MobTabulated(const MOB& mob, const toml::table& tab_tbl) : analytic(mob), field(mob.field_name()) {
+        auto m = [this](double x) { return analytic.of(x); };
+        table = CubicTable("mobility", m, nullptr, TableOptions(tab_tbl));
+        table.report(m);
+    }
+
+    inline double operator()(index_t i, const FieldStore<D>& S) const {
+        const double x = S.get(field).a[i];
+        return table.in_range(x) ? table(x) : analytic.of(x);
+    }
+
+    inline void mobility(const FieldStore<D>& S, index_t begin, index_t n, real* out) const {
+        const real* x = S.get(field).a.data() + begin;
+        table(x, out, n);
+        for(index_t k = 0; k < n; k++) {
+            if(!table.in_range(x[k])) {
+                out[k] = analytic.of(x[k]);
+            }
+        }
+    }
+};
+
+}  // namespace circa
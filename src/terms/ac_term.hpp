@@ -1,10 +1,16 @@
 #pragma once
+#include <algorithm>
+#include <stdexcept>
+#include <vector>
+
+#include "../core/reduce.hpp"
 #include "../core/system.hpp"
+#include "../util/math.hpp"
 
 namespace circa {
 
 template <int D, class FE, class Ops>
-struct ACTerm : ITerm<D> {
+struct ACTerm : ITerm<D>, IEnergy<D> {
     FieldStore<D>* S = nullptr;
     FieldStore<D>* dSdt = nullptr;
     const Ops& ops;
@@ -20,13 +26,88 @@ struct ACTerm : ITerm<D> {
         dSdt = dSout;
     }
 
+    int halo() const override {
+        return 0;
+    }
+
+    TermKind kind() const override {
+        return TermKind::POINTWISE;
+    }
+
     void add_rhs() override {
-        const Field<D>& c = S->get(c_name);
-        const Field<D>* drv = driver_name.empty() ? nullptr : S->maybe(driver_name);
-        Field<D>& out = dSdt->ensure(c_name);
-        for(int i = 0; i < c.g.size; i++) {
+        prepare_pointwise();
+        add_rhs_range(0, c->g.size);
+    }
+
+    void prepare_pointwise() override {
+        c = &S->get(c_name);
+        drv = driver_name.empty() ? nullptr : S->maybe(driver_name);
+        out = &dSdt->ensure(c_name);
+        // a requested energy is recorded during this evaluation only
+        recording_now = recording;
+        recording = false;
+        if(recording_now) {
+            E_blocks.clear();
+        }
+    }
+
+    void add_rhs_range(index_t begin, index_t end) override {
+        for(index_t i = begin; i < end; i++) {
             double driver = drv ? drv->a[i] : 0.0;
-            out.a[i] += -fe.dfdc(c.a[i], driver);
+            out->a[i] += -fe.dfdc(c->a[i], driver);
+        }
+        if(recording_now) {
+            // one partial sum per reduction block, as in reduce::sum
+            for(index_t b = begin; b < end;) {
+                const index_t e = std::min(end, (b / reduce::block + 1) * reduce::block);
+                E_blocks.push_back(reduce::block_sum(b, e, [this](index_t i) {
+                    return energy_density(i);
+                }));
+                b = e;
+            }
+        }
+    }
+
+    double energy() const override {
+        const Field<D>& cf = S->get(c_name);
+        const Field<D>* df = driver_name.empty() ? nullptr : S->maybe(driver_name);
+        const double E = reduce::sum(cf.g.size, [&](index_t i) {
+            return fe.f(cf.a[i], df ? df->a[i] : 0.0);
+        });
+        check_energy(E);
+        return E * cf.g.dV;
+    }
+
+    bool records_energy() const override {
+        return true;
+    }
+
+    void record_energy() override {
+        recording = true;
+    }
+
+    double recorded_energy() const override {
+        const double E = reduce::combine(E_blocks);
+        check_energy(E);
+        return E * S->g.dV;
+    }
+
+   private:
+    // set by prepare_pointwise()
+    const Field<D>* c = nullptr;
+    const Field<D>* drv = nullptr;
+    Field<D>* out = nullptr;
+
+    bool recording = false, recording_now = false;
+    std::vector<double> E_blocks;
+
+    double energy_density(index_t i) const {
+        return fe.f(c->a[i], drv ? drv->a[i] : 0.0);
+    }
+
+    static void check_energy(double E) {
+        if(util::safe_isnan(E)) {
+            throw std::runtime_error("nan detected in free energy density computation");
         }
     }
 };
@@ -1,6 +1,10 @@
 #pragma once
+#include <algorithm>
+#include <vector>
+
 #include "../core/system.hpp"
 #include "../ops/deriv_ops.hpp"
+#include "../physics/batched.hpp"
 #include "../util/math.hpp"
 
 namespace circa {
@@ -9,11 +13,15 @@ template <int D, class FE, class M, class Ops>
 struct CHTerm : ITerm<D>, IEnergy<D> {
     FieldStore<D>* S = nullptr;
     FieldStore<D>* dSdt = nullptr;
+    Workspace<D>* ws = nullptr;
+    OpCache<D>* cache = nullptr;
     const Ops& ops;
     std::string target;
     FE fe;
     M Mfun;
     double kappa;
+    std::vector<ITerm<D>*> fused;  // pointwise terms evaluated in add_rhs
+    static constexpr index_t chunk = reduce::block;  // energy partial sums are per block
 
     CHTerm(FieldStore<D>& S0, FieldStore<D>& dS0, const Ops& ops_, std::string tgt, FE fe_, M m_, double k)
         : S(&S0), dSdt(&dS0), ops(ops_), target(std::move(tgt)), fe(fe_), Mfun(m_), kappa(k) {}
@@ -23,53 +31,117 @@ struct CHTerm : ITerm<D>, IEnergy<D> {
         dSdt = dSout;
     }
 
+    void set_workspace(Workspace<D>* w) override {
+        ws = w;
+    }
+
+    void set_op_cache(OpCache<D>* c) override {
+        cache = c;
+    }
+
+    // μ needs the neighbours reached by the laplacian, and div(M grad μ) those of μ
+    int halo() const override {
+        return ops.laplacian_reach() + ops.div_M_grad_reach();
+    }
+
+    bool fuse(ITerm<D>* pointwise) override {
+        if(std::find(fused.begin(), fused.end(), pointwise) == fused.end()) {
+            fused.push_back(pointwise);
+        }
+        return true;
+    }
+
     void add_rhs() override {
         const Field<D>& u = S->get(target);
-        Field<D> lap_u = ops.laplacian(u);
+        const Field<D>& lap_u = cache->laplacian(ops, u);
 
-        Field<D> mu(u.g);
-        for(int i = 0; i < u.g.size; ++i) {
-            mu.a[i] = fe.mu(u.a[i]) - 2.0 * kappa * lap_u.a[i];
+        // μ and the mobility are computed in chunks that stay in cache, together with the pointwise
+        // terms fused into this one, which often read the same fields
+        Field<D>& mu = ws->borrow("ch.mu", u.g);
+        Field<D>& mobility = ws->borrow("ch.mobility", u.g);
+        for(auto* t : fused) {
+            t->prepare_pointwise();
+        }
+        // the energy, if requested, is accumulated in the same sweep, with one partial sum per chunk
+        // that are then combined as in reduce::sum, so that the result is the same as that of energy()
+        const bool with_energy = recording;
+        std::vector<double> E_chunks;
+        for(index_t b = 0; b < u.g.size; b += chunk) {
+            const index_t n = std::min(chunk, u.g.size - b);
+            batch_mu(fe, u.a.data() + b, mu.a.data() + b, n);
+            for(index_t i = b; i < b + n; ++i) {
+                mu.a[i] -= 2.0 * kappa * lap_u.a[i];
+            }
+            if(with_energy) {
+                E_chunks.push_back(reduce::block_sum(b, b + n, [&](index_t i) {
+                    return energy_density(u.a[i], lap_u.a[i]);
+                }));
+            }
+            batch_mobility<D>(Mfun, *S, b, n, mobility.a.data() + b);
+            for(auto* t : fused) {
+                t->add_rhs_range(b, b + n);
+            }
         }
 
-        // mobility per cell
-        Field<D> mobility(u.g);
-        for(int i = 0; i < u.g.size; ++i) {
-            mobility.a[i] = Mfun(i, *S);
+        if(with_energy) {
+            recording = false;
+            const double E = reduce::combine(E_chunks);
+            check_energy(E);
+            recorded = E * u.g.dV;
         }
 
         // Conservative ∇·(M ∇μ)
-        Field<D> dudt = ops.div_M_grad(mobility, mu);
+        Field<D>& dudt = ws->borrow("ch.dudt", u.g);
+        ops.div_M_grad(mobility, mu, dudt);
 
         // Field<D> dudt = ops.divergence(flux);
         Field<D>& out = dSdt->ensure(target);
         if(out.empty()) out = Field<D>(u.g);
-        for(int i = 0; i < u.g.size; ++i) {
+        for(index_t i = 0; i < u.g.size; ++i) {
             out.a[i] += dudt.a[i];
         }
     }
 
+    // The interfacial term is summed by parts, κ|∇u|² -> -κ u ∇²u, so that the energy is the one whose
+    // variational derivative is μ, and so that it can be computed in add_rhs from the same laplacian
     double energy() const override {
-        const Field<D> &u = S->get(target);
+        const Field<D>& u = S->get(target);
+        const Field<D>& lap_u = cache->laplacian(ops, u);
 
-        auto gu = ops.gradient(u);
+        const double E = reduce::sum(u.g.size, [&](index_t i) {
+            return energy_density(u.a[i], lap_u.a[i]);
+        });
+        check_energy(E);
+        return E * u.g.dV;
+    }
 
-        double E = 0.0;
-        for(int i = 0; i < u.g.size; ++i) {
-            double grad2 = 0.0;
-            for(int d = 0; d < D; d++) {
-                grad2 += gu[d].a[i] * gu[d].a[i];
-            }
-            double e_bulk = fe.bulk(u.a[i]);
+    bool records_energy() const override {
+        return true;
+    }
 
-            if(util::safe_isnan(e_bulk)) {
-                throw std::runtime_error("nan detected in free energy density computation");
-            }
+    void record_energy() override {
+        recording = true;
+    }
+
+    double recorded_energy() const override {
+        return recorded;
+    }
+
+   private:
+    bool recording = false;
+    double recorded = 0.0;
+
+    double energy_density(double u, double lap_u) const {
+        double e_bulk = fe.bulk(u);
+        double e_interfacial = -kappa * u * lap_u;
+        return e_bulk + e_interfacial;
+    }
 
-            double e_interfacial = kappa * grad2;
-            E += (e_bulk + e_interfacial) * u.g.dV;
+    // a nan anywhere makes the sum nan (the check cannot be done per site in a parallel reduction)
+    static void check_energy(double E) {
+        if(util::safe_isnan(E)) {
+            throw std::runtime_error("nan detected in free energy density computation");
         }
-        return E;
     }
 };
 
@@ -1,10 +1,15 @@
 #pragma once
+#include <array>
 #include <string>
 #include <type_traits>
 #include <vector>
 
+#include "../core/multi_field.hpp"
+#include "../core/reduce.hpp"
 #include "../core/system.hpp"
 #include "../ops/deriv_ops.hpp"
+#include "../ops/fd_shapes.hpp"
+#include "../util/math.hpp"
 
 namespace circa {
 
@@ -22,15 +27,23 @@ struct has_M_i {
 };
 
 // MOB must offer either:
-//   double M_i(int i_species, int idx_site, const FieldStore<D>& S)          // diagonal case
+//   double M_i(int i_species, index_t idx_site, const FieldStore<D>& S)          // diagonal case
 // or
-//   double M_ibeta(int i_species, int beta_species, int idx_site, const FieldStore<D>& S) // full matrix
-template <int D, class FE, class MOB, class Ops>
-struct CHMultiTerm : ITerm<D> {
+//   double M_ibeta(int i_species, int beta_species, index_t idx_site, const FieldStore<D>& S) // full matrix
+// N is the number of species, which is fixed at compile time. L sets the memory layout of the species
+// (and of the temporaries): with AoS the species are packed into a single interleaved field of the
+// state, so that each site is visited only once per pass.
+template <int D, int N, class FE, class MOB, class Ops, SpeciesLayout L = SpeciesLayout::SoA>
+struct CHMultiTerm : ITerm<D>, IEnergy<D> {
+    using View = SpeciesView<N, L, real>;
+    using ConstView = SpeciesView<N, L, const real>;
+
     FieldStore<D>* S = nullptr;
     FieldStore<D>* dSdt = nullptr;
+    Workspace<D>* ws = nullptr;
     const Ops& ops;
     std::vector<std::string> target;  // names of the N species
+    std::string group;                // name of the interleaved field (AoS only)
     FE fe;
     MOB mob;
     // TODO: make kappa a vector, one value per species
@@ -38,75 +51,223 @@ struct CHMultiTerm : ITerm<D> {
 
     CHMultiTerm(FieldStore<D>& S0, FieldStore<D>& dS0, const Ops& ops_,
                 std::vector<std::string> targets, FE fe_, MOB mob_, double k)
-        : S(&S0), dSdt(&dS0), ops(ops_), target(std::move(targets)), fe(fe_), mob(mob_), kappa(k) {}
+        : S(&S0), dSdt(&dS0), ops(ops_), target(std::move(targets)), fe(fe_), mob(mob_), kappa(k) {
+        if((int)target.size() != N) {
+            throw std::runtime_error("CH_multi: expected " + std::to_string(N) + " targets, got " + std::to_string(target.size()));
+        }
+        if constexpr (L == SpeciesLayout::AoS) {
+            for(const auto& t : target) {
+                group += (group.empty() ? "" : "+") + t;
+            }
+            S->pack(group, target);
+        }
+    }
 
     void set_state(FieldStore<D>* Sin, FieldStore<D>* dSout) override {
         S = Sin;
         dSdt = dSout;
     }
 
+    void set_workspace(Workspace<D>* w) override {
+        ws = w;
+    }
+
+    // μ and the face fluxes each look one site further. The stencils are always second order: other
+    // orders and stencils are rejected when the term is configured
+    int halo() const override {
+        return 2;
+    }
+
     void add_rhs() override {
-        const int N = (int)target.size();
-        // gather φ_i and ∇²φ_i
-        std::vector<const Field<D>*> phi(N);
-        std::vector<Field<D>> lap(N);
-        for(int a = 0; a < N; a++) {
-            phi[a] = &S->get(target[a]);
-            lap[a] = ops.laplacian(*phi[a]);
-        }
+        const Grid<D>& g = S->g;
+        const ConstView phi = state_view();
+        const View out = rhs_view();
+        const View mu = borrow_view("ch_multi.mu", g);
 
-        // μ_i
-        std::vector<Field<D>> mu = fe.template mu<D>(phi);
+        // the energy density, if requested, is stored and summed once the sweep is done
+        const bool with_energy = recording;
+        recording = false;
+        real* e = with_energy ? ws->borrow("ch_multi.energy", g).a.data() : nullptr;
 
-        // ∇μ_i
-        std::vector<std::array<Field<D>, D>> grad_mu(N);
-        for(int i = 0; i < N; i++) {
-            for(int d = 0; d < D; d++) {
-                grad_mu[i][d] = Field<D>(phi[i]->g);
+        // μ_i = ∂f/∂φ_i - 2 κ ∇²φ_i
+        for_each_site(g, phi, [&](index_t p, const std::array<double, N>& ph, const std::array<double, N>& lap) {
+            const std::array<double, N> mu_bulk = fe.mu(ph);
+            for(int s = 0; s < N; s++) {
+                mu(s, p) = mu_bulk[s] - 2.0 * kappa * lap[s];
             }
-            axpy(mu[i], lap[i], -2.0 * kappa);  // μ_i -= 2 κ ∇²φ_i
-            grad_mu[i] = ops.gradient(mu[i]);
+            if(with_energy) {
+                e[p] = energy_density(ph, lap);
+            }
+        });
+        if(with_energy) {
+            const double E = reduce::sum(g.size, [e](index_t i) {
+                return double(e[i]);
+            });
+            check_energy(E);
+            recorded = E * g.dV;
         }
 
-        // For each species i: J_i = -sum_beta M_{iβ} ∇μ_β   (diagonal => only β=i)
-        for(int i = 0; i < N; i++) {
-            std::array<Field<D>, D> flux;
-            for(int d = 0; d < D; d++) {
-                flux[d] = Field<D>(phi[i]->g);
-            }
+        // dφ_i/dt = -∇·J_i with J_i = -sum_β M_{iβ} ∇μ_β (diagonal => only β=i). As in FDOps::div_M_grad,
+        // the fluxes are evaluated at the faces between neighbouring sites, with the mobility averaged
+        // over the two sites, so that the stencil is compact and conservative
+        const auto& n = g.n;
+        fd::for_each_row<D>(n, [&](index_t b, const auto& bp, const auto& bm) {
+            fd::sweep_x(n, [&](int x, int xp, int xm) {
+                const index_t p = b + x;
+                std::array<double, N> div{};
+                for(int d = 0; d < D; d++) {
+                    const double inv_dx2 = 1.0 / (g.dx[d] * g.dx[d]);
+                    const index_t ip = (d == 0) ? b + xp : bp[d] + x;
+                    const index_t im = (d == 0) ? b + xm : bm[d] + x;
+                    face_flux(p, ip, mu, inv_dx2, div);
+                    face_flux(p, im, mu, inv_dx2, div);
+                }
+                for(int i = 0; i < N; i++) {
+                    out(i, p) += div[i];
+                }
+            });
+        });
+    }
+
+    // The interfacial term is summed by parts, as in CHTerm: κ Σ_i |∇φ_i|² -> -κ Σ_i φ_i ∇²φ_i
+    double energy() const override {
+        const Grid<D>& g = S->g;
+        const ConstView phi = state_view();
+        // the densities are stored first, so that they are summed in the same order as in add_rhs
+        std::vector<real> e(g.size);
+        for_each_site(g, phi, [&](index_t p, const std::array<double, N>& ph, const std::array<double, N>& lap) {
+            e[p] = energy_density(ph, lap);
+        });
+        const double E = reduce::sum(g.size, [&e](index_t i) {
+            return double(e[i]);
+        });
+        check_energy(E);
+        return E * g.dV;
+    }
+
+    bool records_energy() const override {
+        return true;
+    }
+
+    void record_energy() override {
+        recording = true;
+    }
+
+    double recorded_energy() const override {
+        return recorded;
+    }
+
+   private:
+    bool recording = false;
+    double recorded = 0.0;
 
-            if constexpr (has_M_i<MOB, D>::value) {
-                // diagonal mobility
-                for(int p = 0; p < phi[i]->g.size; ++p) {
-                    const double Mi = mob.M_i(i, p, *S);
-                    for(int d = 0; d < D; ++d)
-                        flux[d].a[p] = -Mi * grad_mu[i][d].a[p];
+    // Call fn(p, ph, lap) for each site p, with the values of the species at p and their laplacians.
+    // The grid is traversed row by row, as in FDOps, so that the neighbours come from row offsets.
+    // The second-order stencil is the one FDOps uses; with AoS, FDOps cannot be applied to single species
+    template <class F>
+    static void for_each_site(const Grid<D>& g, const ConstView& phi, F&& fn) {
+        const auto& n = g.n;
+        fd::for_each_row<D>(n, [&](index_t b, const auto& bp, const auto& bm) {
+            fd::sweep_x(n, [&](int x, int xp, int xm) {
+                const index_t p = b + x;
+                std::array<double, N> ph, lap{};
+                for(int s = 0; s < N; s++) {
+                    ph[s] = phi(s, p);
                 }
-            } 
-            else {
-                // full matrix mobility
-                for(int p = 0; p < phi[i]->g.size; p++) {
-                    for (int d = 0; d < D; d++) {
-                        double acc = 0.0;
-                        for(int b = 0; b < N; b++) {
-                            const double Mib = mob.M_ibeta(i, b, p, *S);
-                            acc += -Mib * grad_mu[b][d].a[p];
-                        }
-                        flux[d].a[p] = acc;
+                for(int d = 0; d < D; d++) {
+                    const double inv_dx2 = 1.0 / (g.dx[d] * g.dx[d]);
+                    const index_t ip = (d == 0) ? b + xp : bp[d] + x;
+                    const index_t im = (d == 0) ? b + xm : bm[d] + x;
+                    for(int s = 0; s < N; s++) {
+                        lap[s] += (phi(s, ip) - 2.0 * ph[s] + phi(s, im)) * inv_dx2;
                     }
                 }
+                fn(p, ph, lap);
+            });
+        });
+    }
+
+    double energy_density(const std::array<double, N>& ph, const std::array<double, N>& lap) const {
+        double e = fe.bulk(ph);
+        for(int s = 0; s < N; s++) {
+            e -= kappa * ph[s] * lap[s];
+        }
+        return e;
+    }
+
+    static void check_energy(double E) {
+        if(util::safe_isnan(E)) {
+            throw std::runtime_error("nan detected in free energy density computation");
+        }
+    }
+
+    // adds sum_β M_{iβ}(p|q) (μ_β(q) - μ_β(p)) / dx², the flux through the face shared by p and q,
+    // to acc[i], where M_{iβ}(p|q) is the average of the mobilities at p and q
+    void face_flux(index_t p, index_t q, const View& mu, double inv_dx2, std::array<double, N>& acc) const {
+        if constexpr (has_M_i<MOB, D>::value) {
+            // diagonal mobility
+            for(int i = 0; i < N; i++) {
+                const double M_f = 0.5 * (mob.M_i(i, p, *S) + mob.M_i(i, q, *S));
+                acc[i] += M_f * (double(mu(i, q)) - mu(i, p)) * inv_dx2;
+            }
+        }
+        else {
+            // full matrix mobility
+            std::array<double, N> dmu;
+            for(int b = 0; b < N; b++) {
+                dmu[b] = (double(mu(b, q)) - mu(b, p)) * inv_dx2;
             }
+            for(int i = 0; i < N; i++) {
+                double sum = 0.0;
+                for(int b = 0; b < N; b++) {
+                    sum += 0.5 * (mob.M_ibeta(i, b, p, *S) + mob.M_ibeta(i, b, q, *S)) * dmu[b];
+                }
+                acc[i] += sum;
+            }
+        }
+    }
+
+    ConstView state_view() const {
+        ConstView v;
+        if constexpr (L == SpeciesLayout::AoS) {
+            v.p = S->get_multi(group).a.data();
+        }
+        else {
+            for(int s = 0; s < N; s++) {
+                v.p[s] = S->get(target[s]).a.data();
+            }
+        }
+        return v;
+    }
 
-            // dφ_i/dt = -∇·J_i
-            Field<D> dphi_dt = ops.divergence(flux);
-            Field<D>& out = dSdt->ensure(target[i]);
-            if(out.empty()) {
-                out = Field<D>(phi[i]->g);
+    View rhs_view() {
+        View v;
+        if constexpr (L == SpeciesLayout::AoS) {
+            v.p = dSdt->ensure_multi(group, target).a.data();
+        }
+        else {
+            for(int s = 0; s < N; s++) {
+                Field<D>& out = dSdt->ensure(target[s]);
+                if(out.empty()) {
+                    out = Field<D>(S->g);
+                }
+                v.p[s] = out.a.data();
             }
-            for(int p = 0; p < phi[i]->g.size; p++) {
-                out.a[p] += dphi_dt.a[p];
+        }
+        return v;
+    }
+
+    View borrow_view(const std::string& key, const Grid<D>& g) {
+        View v;
+        if constexpr (L == SpeciesLayout::AoS) {
+            v.p = ws->borrow_multi(key, g, N).a.data();
+        }
+        else {
+            for(int s = 0; s < N; s++) {
+                v.p[s] = ws->borrow(key + "." + std::to_string(s), g).a.data();
             }
         }
+        return v;
     }
 };
 
@@ -0,0 +1,142 @@
+// Lists the frames of a binary trajectory and extracts them to plain-text or .vti files
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "io/log.hpp"
+#include "io/plain.hpp"
+#include "io/trajectory.hpp"
+#include "io/vtk.hpp"
+
+#include <spdlog/include/spdlog/fmt/ranges.h>
+
+using namespace circa;
+
+namespace {
+
+const char* usage = R"(Usage is {0} trajectory_file command
+
+Commands:
+  list                        print the step and time of each frame
+  extract --step N [options]  write the fields of the frame at step N
+  extract --time T [options]  write the fields of the frame closest to time T
+  extract --all [options]     write the fields of all the frames
+
+Options:
+  --prefix P  file names start with P (default "frame"). Plain-text files are named P_<field>.dat
+              and, with --all, hold all the extracted frames, like the plain-text trajectories.
+              .vti files are named P_<step>.vti and hold all the fields
+  --vti       write .vti files (the only format available in 3D)
+)";
+
+struct Options {
+    std::vector<std::size_t> frames;
+    std::string prefix = "frame";
+    bool vti = false;
+};
+
+template <int D>
+void run(const std::string& filename, const std::vector<std::string>& args) {
+    io::TrajectoryReader<D> reader(filename);
+    const auto& frames = reader.frames();
+
+    if(args[0] == "list") {
+        std::cout << fmt::format("# {}D, size = {}, {} frames", D, fmt::join(reader.grid().n, " "), frames.size()) << std::endl;
+        std::cout << "# frame step t" << std::endl;
+        for(std::size_t k = 0; k < frames.size(); k++) {
+            std::cout << fmt::format("{} {} {}", k, frames[k].step, frames[k].t) << std::endl;
+        }
+        return;
+    }
+    if(args[0] != "extract") {
+        throw std::runtime_error(fmt::format("Unknown command '{}'", args[0]));
+    }
+
+    Options opts;
+    for(std::size_t i = 1; i < args.size(); i++) {
+        auto value = [&]() -> const std::string& {
+            if(i + 1 >= args.size()) {
+                throw std::runtime_error(fmt::format("Option '{}' requires a value", args[i]));
+            }
+            return args[++i];
+        };
+        if(args[i] == "--step") {
+            opts.frames.push_back(reader.find_step(std::stoll(value())));
+        }
+        else if(args[i] == "--time") {
+            opts.frames.push_back(reader.find_time(std::stod(value())));
+        }
+        else if(args[i] == "--all") {
+            for(std::size_t k = 0; k < frames.size(); k++) {
+                opts.frames.push_back(k);
+            }
+        }
+        else if(args[i] == "--prefix") {
+            opts.prefix = value();
+        }
+        else if(args[i] == "--vti") {
+            opts.vti = true;
+        }
+        else {
+            throw std::runtime_error(fmt::format("Unknown option '{}'", args[i]));
+        }
+    }
+    if(opts.frames.empty()) {
+        throw std::runtime_error("Nothing to extract: use --step, --time or --all");
+    }
+    if(D > 2) {
+        opts.vti = true;
+    }
+
+    FieldStore<D> S(reader.grid());
+    bool first = true;
+    for(auto k : opts.frames) {
+        reader.read(k, S);
+        if(opts.vti) {
+            const std::string out = fmt::format("{}_{}.vti", opts.prefix, frames[k].step);
+            io::write_vti(S, out);
+            CIRCA_INFO("Frame {} (step {}, t = {}) written to '{}'", k, frames[k].step, frames[k].t, out);
+        }
+        else {
+            io::dump_all_fields_plain<D>(S, opts.prefix, frames[k].step, frames[k].t, !first);
+            CIRCA_INFO("Frame {} (step {}, t = {}) written to '{}_*.dat'", k, frames[k].step, frames[k].t, opts.prefix);
+        }
+        first = false;
+    }
+}
+
+}  // namespace
+
+int main(int argc, char* argv[]) {
+    if(argc < 3) {
+        std::cerr << fmt::format(usage, argv[0]) << std::endl;
+        return 0;
+    }
+
+    circa::log::init_and_get();
+
+    try {
+        const std::string filename = argv[1];
+        const std::vector<std::string> args(argv + 2, argv + argc);
+        switch(io::trajectory_dims(filename)) {
+            case 1:
+                run<1>(filename, args);
+                break;
+            case 2:
+                run<2>(filename, args);
+                break;
+            case 3:
+                run<3>(filename, args);
+                break;
+            default:
+                throw std::runtime_error(fmt::format("Trajectory '{}' has an invalid header", filename));
+        }
+    }
+    catch(const std::runtime_error& e) {
+        if(std::string(e.what()).length() > 0) {
+            CIRCA_CRITICAL(e.what());
+        }
+        return 1;
+    }
+    return 0;
+}
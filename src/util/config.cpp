@@ -3,7 +3,9 @@
 #include "../core/field_store.hpp"
 #include "../core/grid.hpp"
 #include "../core/system.hpp"
+#include "../io/codec.hpp"
 #include "../io/log.hpp"
+#include "../io/vtk.hpp"
 #include "../ops/fd_ops.hpp"
 #include "../physics/fe_ac_gel.hpp"
 #include "../physics/fe_ch_landau.hpp"
@@ -11,10 +13,13 @@
 #include "../physics/fe_ch_multi_quad.hpp"
 #include "../physics/mobility.hpp"
 #include "../physics/mobility_multi.hpp"
+#include "../physics/tabulated.hpp"
 #include "../terms/ac_term.hpp"
 #include "../terms/ch_term.hpp"
 #include "../terms/ch_term_multi.hpp"
 
+#include <map>
+#include <memory>
 #include <variant>
 #include <string_view>
 
@@ -22,17 +27,41 @@ namespace circa::cfg {
 
 using FE_CH_Any = std::variant<
     FE_CH_Landau,
-    FE_CH_Wertheim
+    FE_CH_Wertheim,
+    FE_CH_Tabulated<FE_CH_Wertheim>
 >;
 
+// Only the Wertheim free energy and mobility can be tabulated: make sure that a [tabulate] table given
+// to any other model does not go unnoticed
+void reject_tabulate(const toml::table* tbl, const std::string& what) {
+    if(tbl && (*tbl)["tabulate"]) {
+        CIRCA_CRITICAL("[tabulate] is not supported by {} (only by the 'wertheim' free energy and mobility)", what);
+        throw std::runtime_error("");
+    }
+}
+
+// the Wertheim free energy and mobility take the log of the density, and can be tabulated only for rho > 0
+void check_wertheim_range(const toml::table& tab_tbl, const std::string& what) {
+    const TableOptions opts(tab_tbl);
+    if(opts.x_min <= 0.0) {
+        CIRCA_CRITICAL("The [tabulate] range of the 'wertheim' {} should start above 0, got [{}, {}]", what, opts.x_min, opts.x_max);
+        throw std::runtime_error("");
+    }
+}
+
 FE_CH_Any parse_ch_fe_any(const toml::table& fe_tbl){
     const auto type = fe_tbl["type"].template value<std::string>().value_or("");
     if(type == "landau"){
+        reject_tabulate(&fe_tbl, "the 'landau' free energy");
         FE_CH_Landau fe(fe_tbl);
         return fe;
     }
     else if(type == "wertheim"){ 
         FE_CH_Wertheim fe(fe_tbl);
+        if(auto tab_tbl = fe_tbl["tabulate"].as_table()) {
+            check_wertheim_range(*tab_tbl, "free energy");
+            return FE_CH_Tabulated<FE_CH_Wertheim>(fe, *tab_tbl);
+        }
         return fe;
     }
     throw std::runtime_error("unknown CH free_energy.type: " + type);
@@ -49,15 +78,18 @@ template<int D>
 MobAny<D> parse_mob_any(const toml::table* mob_tbl){
     const std::string type = value_or<std::string>(mob_tbl, "type", "const");
     if(type == "const"){
+        reject_tabulate(mob_tbl, "the 'const' mobility");
         MobConst<D> m;
         m.M0 = value_or<double>(mob_tbl, "M0", m.M0);
         return m;
     }
 
     if(type == "exp_of_field"){
+        reject_tabulate(mob_tbl, "the 'exp_of_field' mobility");
         MobExpOfField<D> m;
         m.field = value_or<std::string>(mob_tbl, "field", "c");
         m.c0 = value_or<double>(mob_tbl, "c0", 1.0);
+        m.math = vmath::accuracy_from_string(value_or<std::string>(mob_tbl, "math", "exact"));
         return m;
     }
 
@@ -65,6 +97,10 @@ MobAny<D> parse_mob_any(const toml::table* mob_tbl){
         MobWertheimAuto<D> m;
         m.field = value_or<std::string>(mob_tbl, "field", "phi");
         m.D0 = value_or<double>(mob_tbl, "D0", 1.0);
+        m.tabulate = mob_tbl->operator[]("tabulate").as_table();
+        if(m.tabulate) {
+            check_wertheim_range(*m.tabulate, "mobility");
+        }
         return m;
     }
 
@@ -78,56 +114,93 @@ using FE_AC_Any = std::variant<
 FE_AC_Any parse_ac_fe_any(const toml::table& fe_tbl){
     const std::string fe_type = value_or<std::string>(fe_tbl, "type", "");
     if(fe_type == "gel") {
+        reject_tabulate(&fe_tbl, "the 'gel' free energy");
         FE_AC_Gel fe(fe_tbl);
         return fe;
     }
     throw std::runtime_error("unknown AC free_energy.type: " + fe_type);
 }
 
+// CH_multi terms are instantiated for each number of species in [2, CH_MULTI_MAX_SPECIES]
+constexpr int CH_MULTI_MIN_SPECIES = 2;
+constexpr int CH_MULTI_MAX_SPECIES = 8;
+
 using FE_CH_Multi_Any = std::variant<
-    FE_CH_MultiQuad
+    FE_CH_MultiQuad<2>,
+    FE_CH_MultiQuad<3>,
+    FE_CH_MultiQuad<4>,
+    FE_CH_MultiQuad<5>,
+    FE_CH_MultiQuad<6>,
+    FE_CH_MultiQuad<7>,
+    FE_CH_MultiQuad<8>
 >;
 
-FE_CH_Multi_Any parse_ch_multi_fe_any(const toml::table& fe_tbl){
+const toml::array& multi_array_or_die(const toml::table& tbl, const char* key) {
+    auto arr = tbl[key].as_array();
+    if(!arr) {
+        throw std::runtime_error(fmt::format("[free_energy] multi_quad expects array {}", key));
+    }
+    return *arr;
+}
+
+// Turns the runtime number of species into the matching FE_CH_MultiQuad<N> alternative
+template <int N = CH_MULTI_MIN_SPECIES>
+FE_CH_Multi_Any parse_multi_quad(const toml::table& fe_tbl, int n_species) {
+    if constexpr (N > CH_MULTI_MAX_SPECIES) {
+        throw std::runtime_error(fmt::format("CH_multi supports between {} and {} species, got {}", CH_MULTI_MIN_SPECIES, CH_MULTI_MAX_SPECIES, n_species));
+    }
+    else {
+        if(n_species != N) {
+            return parse_multi_quad<N + 1>(fe_tbl, n_species);
+        }
+        FE_CH_MultiQuad<N> fe;
+        fe.a = array_from_toml<double, N>(multi_array_or_die(fe_tbl, "a"), "a");
+        fe.b = array_from_toml<double, N>(multi_array_or_die(fe_tbl, "b"), "b");
+        fe.kappa = array_from_toml<double, N>(multi_array_or_die(fe_tbl, "kappa"), "kappa");
+        fe.chi = matrix_from_toml<double, N>(multi_array_or_die(fe_tbl, "chi"), "chi");
+        return fe;
+    }
+}
+
+FE_CH_Multi_Any parse_ch_multi_fe_any(const toml::table& fe_tbl, int n_species){
     const auto type = fe_tbl["type"].template value<std::string>().value_or("");
 
     if(type == "multi_quad"){
-        FE_CH_MultiQuad fe;
-        fe.a = vector_or<double>(fe_tbl["a"].as_array(), {});
-        fe.b = vector_or<double>(fe_tbl["b"].as_array(), {});
-        fe.kappa = vector_or<double>(fe_tbl["kappa"].as_array(), {});
-        fe.chi = matrix_or<double>(fe_tbl["chi"].as_array(), {});
-        if(fe.a.empty() || fe.b.empty() || fe.kappa.empty() || fe.chi.empty()) {
-            throw std::runtime_error("[free_energy] multi_quad expects a, b, kappa, and chi arrays");
+        reject_tabulate(&fe_tbl, "the 'multi_quad' free energy");
+        if(n_species < CH_MULTI_MIN_SPECIES) {
+            throw std::runtime_error(fmt::format("CH_multi supports between {} and {} species, got {}", CH_MULTI_MIN_SPECIES, CH_MULTI_MAX_SPECIES, n_species));
         }
-        return fe;
+        return parse_multi_quad(fe_tbl, n_species);
     }
     throw std::runtime_error("unknown CH_multi free_energy.type: " + type);
 }
 
-template<int D>
+template<int D, int N>
 using MobMultiAny = std::variant<
-    MobilityDiagConst<D>,
-    MobilityFullConst<D>
+    MobilityDiagConst<D, N>,
+    MobilityFullConst<D, N>
 >;
 
-template<int D>
-MobMultiAny<D> parse_multi_mob_any(const toml::table* mob_tbl){
+template<int D, int N>
+MobMultiAny<D, N> parse_multi_mob_any(const toml::table* mob_tbl){
     const std::string type = value_or<std::string>(mob_tbl, "type", "diag_const");
+    const toml::array* M = mob_tbl ? mob_tbl->operator[]("M").as_array() : nullptr;
     if(type == "diag_const"){
-        MobilityDiagConst<D> m;
-        m.M = vector_or<double>(mob_tbl ? mob_tbl->operator[]("M").as_array() : nullptr, {});
-        if(m.M.empty()) {
+        reject_tabulate(mob_tbl, "the 'diag_const' mobility");
+        if(!M) {
             throw std::runtime_error("[mobility] diag_const expects array M");
         }
+        MobilityDiagConst<D, N> m;
+        m.M = array_from_toml<double, N>(*M, "M");
         return m;
     }
     if(type == "full_const"){
-        MobilityFullConst<D> m;
-        m.M = matrix_or<double>(mob_tbl ? mob_tbl->operator[]("M").as_array() : nullptr, {});
-        if(m.M.empty()) {
+        reject_tabulate(mob_tbl, "the 'full_const' mobility");
+        if(!M) {
             throw std::runtime_error("[mobility] full_const expects matrix M");
         }
+        MobilityFullConst<D, N> m;
+        m.M = matrix_from_toml<double, N>(*M, "M");
         return m;
     }
     throw std::runtime_error("unknown CH_multi mobility.type: " + type);
@@ -176,7 +249,7 @@ std::vector<TermSpec<D>> parse_term_specs(const toml::table& root) {
             }
         }
         s.tbl = t;
-        if(s.kind.empty() || s.target.empty()) {
+        if(s.kind.empty() || (s.target.empty() && s.target_multi.empty())) {
             throw std::runtime_error("term missing 'kind' or 'target'");
         }
 
@@ -194,10 +267,45 @@ std::vector<TermSpec<D>> parse_term_specs(const toml::table& root) {
 
 // Concrete "ops" resolve
 template <int D>
-const DerivOps<D>& resolve_ops(const std::string& ops_type, const toml::table* /*ops_tbl*/) {
+const DerivOps<D>& resolve_ops(const std::string& ops_type, const toml::table* ops_tbl) {
     if(ops_type == "fd") {
-        static FDOps<D> fd;
-        return fd;
+        int order = 2;
+        std::string stencil_name = "standard";
+        if(ops_tbl) {
+            order = (*ops_tbl)["order"].value_or(order);
+            stencil_name = (*ops_tbl)["stencil"].value_or(stencil_name);
+        }
+
+        FDStencil stencil;
+        if(stencil_name == "standard") {
+            stencil = FDStencil::STANDARD;
+        }
+        else if(stencil_name == "isotropic") {
+            stencil = FDStencil::ISOTROPIC;
+        }
+        else if(stencil_name == "isotropic27" && D == 3) {
+            stencil = FDStencil::ISOTROPIC_27;
+        }
+        else {
+            CIRCA_CRITICAL("Unsupported ops.stencil '{}' (should be \"standard\", \"isotropic\" or, in 3D, \"isotropic27\")", stencil_name);
+            throw std::runtime_error("");
+        }
+        if(order != 2 && order != 4) {
+            CIRCA_CRITICAL("Unsupported ops.order {} (should be 2 or 4)", order);
+            throw std::runtime_error("");
+        }
+        if(order == 4 && stencil != FDStencil::STANDARD) {
+            CIRCA_CRITICAL("Isotropic stencils are available only with ops.order = 2");
+            throw std::runtime_error("");
+        }
+
+        // terms keep a reference to their ops, which should therefore live as long as the program
+        static std::map<std::pair<int, FDStencil>, std::unique_ptr<FDOps<D>>> instances;
+        auto& fd = instances[{order, stencil}];
+        if(!fd) {
+            fd = std::make_unique<FDOps<D>>(order, stencil);
+        }
+        return *fd;
     }
     throw std::runtime_error("Unknown ops.type: " + ops_type);
 }
@@ -260,12 +368,23 @@ std::unique_ptr<ITerm<D>> build_one_term(FieldStore<D>& S, FieldStore<D>& dS, co
                 }
 
                 if constexpr (std::is_same_v<MOB, MobWertheimAuto<D>>) {
-                    if constexpr (!std::is_same_v<FE, FE_CH_Wertheim>) {
+                    using FE_analytic = std::decay_t<decltype(analytic_of(fe))>;
+                    if constexpr (!std::is_same_v<FE_analytic, FE_CH_Wertheim>) {
                         throw std::runtime_error("mobility.type=wertheim_coupled requires free_energy.type=wertheim");
                     } 
                     else {
-                        MobWertheimBound<D, FE> bound{mob, &fe};
-                        return std::make_unique<CHTerm<D, FE, MobWertheimBound<D, FE>, FDOps<D>>>(
+                        if(mob.tabulate) {
+                            // the mobility table is built from the analytic model
+                            using Bound = MobWertheimBound<D, FE_analytic>;
+                            Bound bound{mob, analytic_of(fe)};
+                            return std::make_unique<CHTerm<D, FE, MobTabulated<D, Bound>, FDOps<D>>>(
+                                S, dS, *fd, spec.target, fe, MobTabulated<D, Bound>(bound, *mob.tabulate), k
+                            );
+                        }
+                        // with a tabulated free energy, dmu/drho comes from its table
+                        using Bound = MobWertheimBound<D, FE>;
+                        Bound bound{mob, fe};
+                        return std::make_unique<CHTerm<D, FE, Bound, FDOps<D>>>(
                             S, dS, *fd, spec.target, fe, bound, k
                         );
                     }
@@ -288,20 +407,39 @@ std::unique_ptr<ITerm<D>> build_one_term(FieldStore<D>& S, FieldStore<D>& dS, co
 
         double k = *value_or_die<double>(spec.tbl, "kappa");
 
-        auto fe_any = parse_ch_multi_fe_any(*fe_tbl);
-        auto mob_any = parse_multi_mob_any<D>(mob_tbl);
+        auto fe_any = parse_ch_multi_fe_any(*fe_tbl, (int)spec.target_multi.size());
+        const std::string layout = value_or<std::string>(spec.tbl, "layout", "soa");
+        if(layout != "soa" && layout != "aos") {
+            throw std::runtime_error(spec.id + ": unknown layout '" + layout + "' (should be 'soa' or 'aos')");
+        }
 
         return std::visit(
-        [&](auto&& fe, auto&& mob) -> std::unique_ptr<ITerm<D>> {
+        [&](auto&& fe) -> std::unique_ptr<ITerm<D>> {
             using FE  = std::decay_t<decltype(fe)>;
-            using MOB = std::decay_t<decltype(mob)>;
-            auto fd = dynamic_cast<const FDOps<D>*>(&ops);
-            if(!fd) {
-                throw std::runtime_error("CH_multi requires FDOps backend");
-            }
-            return std::make_unique<CHMultiTerm<D, FE, MOB, FDOps<D>>>(S, dS, *fd, spec.target_multi, fe, mob, k);
+            constexpr int N = FE::n_species;
+            auto mob_any = parse_multi_mob_any<D, N>(mob_tbl);
+
+            return std::visit(
+            [&](auto&& mob) -> std::unique_ptr<ITerm<D>> {
+                using MOB = std::decay_t<decltype(mob)>;
+                auto fd = dynamic_cast<const FDOps<D>*>(&ops);
+                if(!fd) {
+                    throw std::runtime_error("CH_multi requires FDOps backend");
+                }
+                // CH_multi has its own (second-order, axial) stencils, see CHMultiTerm::for_each_site
+                if(fd->order != 2 || fd->stencil != FDStencil::STANDARD) {
+                    CIRCA_CRITICAL("{}: CH_multi supports only ops.order = 2 and ops.stencil = \"standard\"", spec.id);
+                    throw std::runtime_error("");
+                }
+                if(layout == "aos") {
+                    return std::make_unique<CHMultiTerm<D, N, FE, MOB, FDOps<D>, SpeciesLayout::AoS>>(S, dS, *fd, spec.target_multi, fe, mob, k);
+                }
+                return std::make_unique<CHMultiTerm<D, N, FE, MOB, FDOps<D>, SpeciesLayout::SoA>>(S, dS, *fd, spec.target_multi, fe, mob, k);
+            },
+            mob_any
+            );
         },
-        fe_any, mob_any
+        fe_any
         );
     }
     else if(spec.kind == "AC") {
@@ -330,6 +468,32 @@ std::unique_ptr<ITerm<D>> build_one_term(FieldStore<D>& S, FieldStore<D>& dS, co
     throw std::runtime_error(spec.id + ": unknown term kind: " + spec.kind);
 }
 
+// Either the name of a codec or a table such as { codec = "quantize", tolerance = 1e-4 }
+io::Compression parse_compression(const toml::node& node, const std::string& where) {
+    io::Compression c;
+    if(auto name = node.value<std::string>()) {
+        c.codec = io::codec_from_name(*name);
+    }
+    else if(auto tbl = node.as_table()) {
+        c.codec = io::codec_from_name(*value_or_die<std::string>(*tbl, "codec"));
+        c.level = value_or<int>(tbl, "level", c.level);
+        c.tolerance = value_or<double>(tbl, "tolerance", c.tolerance);
+    }
+    else {
+        CIRCA_CRITICAL("{} should be either the name of a compression codec or a table", where);
+        throw std::runtime_error("");
+    }
+    if(c.codec == io::Codec::ZLIB && (c.level < 1 || c.level > 9)) {
+        CIRCA_CRITICAL("{}: the zlib level should be between 1 and 9, got {}", where, c.level);
+        throw std::runtime_error("");
+    }
+    if(c.codec == io::Codec::QUANTIZE && !(c.tolerance > 0.0)) {
+        CIRCA_CRITICAL("{}: the quantize compression requires a positive tolerance", where);
+        throw std::runtime_error("");
+    }
+    return c;
+}
+
 template <int D> GeneralConfig<D> load(const std::string& path) {
     GeneralConfig<D> config;
 
@@ -358,6 +522,23 @@ template <int D> GeneralConfig<D> load(const std::string& path) {
     else {
         config.grid.L.fill(*gsec["L"].template value<double>());
     }
+    // tiles = "auto" (the default) | "off" | [tile_y, tile_z]. Used in 3D only
+    if(gsec["tiles"].is_array()) {
+        auto yz = array_from_toml<int, 2>(*gsec["tiles"].as_array(), "grid.tiles");
+        config.grid.autotune_tiles = false;
+        config.grid.tiles = yz;
+    }
+    else {
+        std::string tiles = gsec["tiles"].value_or(std::string("auto"));
+        if(tiles == "off") {
+            config.grid.autotune_tiles = false;
+        }
+        else if(tiles != "auto") {
+            CIRCA_CRITICAL("Invalid grid.tiles value '{}' (should be \"auto\", \"off\" or [tile_y, tile_z])", tiles);
+            throw std::runtime_error("");
+        }
+    }
+    config.grid.tile_cache = gsec["tile_cache"].value_or(std::string(""));
 
     // fields
     auto fields = config.raw_table["fields"].as_array();
@@ -402,23 +583,122 @@ template <int D> GeneralConfig<D> load(const std::string& path) {
         config.time.steps = t["steps"].value_or(config.time.steps);
     }
 
+    // checkpoints
+    if(auto c = config.raw_table["checkpoint"]) {
+        config.checkpoint.every = c["every"].value_or(config.checkpoint.every);
+        config.checkpoint.filename = c["filename"].value_or(config.checkpoint.filename);
+        config.checkpoint.restart = c["restart"].value_or(config.checkpoint.restart);
+        if(config.checkpoint.every < 0) {
+            CIRCA_CRITICAL("checkpoint.every should be non-negative (0 = no checkpoints), got {}", config.checkpoint.every);
+            throw std::runtime_error("");
+        }
+    }
+
     // output
     if(auto o = config.raw_table["output"]) {
         config.out.output_append = o["output_append"].value_or(config.out.output_append);
         config.out.output_filename = o["output_filename"].value_or(config.out.output_filename);
+        config.out.terms_filename = o["terms_filename"].value_or(config.out.terms_filename);
         config.out.output_every = *value_or_die<int>(*o.as_table(), "output_every");
         config.out.conf_every = *value_or_die<int>(*o.as_table(), "conf_every");
+        if(config.out.output_every < 1 || config.out.conf_every < 0) {
+            CIRCA_CRITICAL("output.output_every should be positive and output.conf_every non-negative (0 = only the final configuration)");
+            throw std::runtime_error("");
+        }
+        config.out.output_queue = o["output_queue"].value_or(config.out.output_queue);
+        if(config.out.output_queue < 0) {
+            CIRCA_CRITICAL("output.output_queue should be non-negative (0 = synchronous output), got {}", config.out.output_queue);
+            throw std::runtime_error("");
+        }
+
+        config.out.trajectory_format = o["trajectory_format"].value_or(config.out.trajectory_format);
+        config.out.trajectory_filename = o["trajectory_filename"].value_or(config.out.trajectory_filename);
+        if(config.out.trajectory_format != "plain" && config.out.trajectory_format != "binary") {
+            CIRCA_CRITICAL("output.trajectory_format should be either 'plain' or 'binary', got '{}'", config.out.trajectory_format);
+            throw std::runtime_error("");
+        }
+        if(auto c = o["trajectory_compression"].node()) {
+            config.out.trajectory_compression = parse_compression(*c, "output.trajectory_compression");
+        }
+        if(auto per_field = o["field_compression"].as_table()) {
+            for(auto&& [name, node] : *per_field) {
+                const std::string field(name.str());
+                if(std::find(config.fields.names.begin(), config.fields.names.end(), field) == config.fields.names.end()) {
+                    throw std::runtime_error("field_compression refers to unknown field: " + field);
+                }
+                config.out.field_compression[field] = parse_compression(node, "output.field_compression." + field);
+            }
+        }
+        if(config.out.trajectory_format != "binary" && (config.out.trajectory_compression.codec != io::Codec::NONE || !config.out.field_compression.empty())) {
+            CIRCA_WARN("Compression is applied only to binary trajectories (output.trajectory_format = \"binary\")");
+        }
 
         if constexpr (D < 3) {
             config.out.print_vtk = o["print_vtk"].value_or(config.out.print_vtk);
             config.out.vtk_dir = o["vtk_dir"].value_or(config.out.vtk_dir);
         } 
         else if constexpr (D == 3) { // for D == 3 the vtk output is the only possible one so we enable it by default
-            config.out.print_vtk = true;
+            config.out.print_vtk = o["print_vtk"].value_or(true);
         }
         else {
             CIRCA_WARN("There is no output format available for D > 3");
         }
+        if constexpr (D == 3) {
+            config.out.vtk_dir = o["vtk_dir"].value_or(config.out.vtk_dir);
+        }
+        config.out.vtk_format = o["vtk_format"].value_or(config.out.vtk_format);
+        config.out.vtk_compression = o["vtk_compression"].value_or(config.out.vtk_compression);
+        io::vtk_format_from_name(config.out.vtk_format);  // throws if the format is unknown
+        if(config.out.vtk_compression < 0 || config.out.vtk_compression > 9) {
+            CIRCA_CRITICAL("output.vtk_compression should be between 0 (no compression) and 9, got {}", config.out.vtk_compression);
+            throw std::runtime_error("");
+        }
+
+        // in-situ output
+        if(auto arr = o["slices"].as_array()) {
+            for(auto&& v : *arr) {
+                auto tbl = v.as_table();
+                if(tbl == nullptr) {
+                    throw std::runtime_error("slices must be tables such as { axis = \"z\", index = 10 }");
+                }
+                const std::string axis = *value_or_die<std::string>(*tbl, "axis");
+                io::SliceSpec s;
+                s.axis = (axis == "x") ? 0 : (axis == "y") ? 1 : (axis == "z") ? 2 : -1;
+                if(s.axis < 0 || s.axis >= D) {
+                    CIRCA_CRITICAL("Invalid slice axis '{}' for a {}D simulation", axis, D);
+                    throw std::runtime_error("");
+                }
+                s.index = value_or<int>(tbl, "index", config.grid.n[s.axis] / 2);  // the middle plane by default
+                if(s.index < 0 || s.index >= config.grid.n[s.axis]) {
+                    CIRCA_CRITICAL("The index of a slice along {} should be between 0 and {}, got {}", axis, config.grid.n[s.axis] - 1, s.index);
+                    throw std::runtime_error("");
+                }
+                config.out.slices.push_back(s);
+            }
+        }
+        config.out.slice_every = o["slice_every"].value_or(config.out.slice_every);
+        config.out.downsample = o["downsample"].value_or(config.out.downsample);
+        config.out.downsample_every = o["downsample_every"].value_or(config.out.downsample_every);
+        if(config.out.slice_every < 0 || config.out.downsample_every < 0) {
+            CIRCA_CRITICAL("output.slice_every and output.downsample_every should be non-negative (0 = never)");
+            throw std::runtime_error("");
+        }
+        if(config.out.downsample == 1 || config.out.downsample < 0) {
+            CIRCA_CRITICAL("output.downsample should be either 0 (no downsampled output) or larger than 1, got {}", config.out.downsample);
+            throw std::runtime_error("");
+        }
+        for(int d = 0; d < D && config.out.downsample > 1; d++) {
+            if(config.grid.n[d] % config.out.downsample != 0) {
+                CIRCA_CRITICAL("output.downsample ({}) should divide the number of grid points along each dimension ({} along {})", config.out.downsample, config.grid.n[d], d);
+                throw std::runtime_error("");
+            }
+        }
+        if(!config.out.slices.empty() && config.out.slice_every == 0) {
+            CIRCA_WARN("Slices have been specified, but output.slice_every is 0: they will not be written");
+        }
+        if(config.out.downsample > 1 && config.out.downsample_every == 0) {
+            CIRCA_WARN("output.downsample has been set, but output.downsample_every is 0: downsampled copies will not be written");
+        }
 
         if(auto arr = o["mass_fields"].as_array()) {
             config.out.mass_fields.reserve(arr->size());
@@ -447,6 +727,12 @@ template <int D> GeneralConfig<D> load(const std::string& path) {
     // integrator
     if(auto isec = config.raw_table["integrator"]) {
         config.integrator.name = isec["name"].value_or(config.integrator.name);
+        config.integrator.time_block = isec["time_block"].value_or(config.integrator.time_block);
+        config.integrator.time_tile = isec["time_tile"].value_or(config.integrator.time_tile);
+        if(config.integrator.time_block < 1 || config.integrator.time_tile < 1) {
+            CIRCA_CRITICAL("integrator.time_block and integrator.time_tile should be positive");
+            throw std::runtime_error("");
+        }
     }
 
     auto specs = parse_term_specs<D>(config.raw_table);
@@ -454,6 +740,7 @@ template <int D> GeneralConfig<D> load(const std::string& path) {
         System<D> sys;
         for(const auto& spec : specs) {
             auto term = build_one_term<D>(S_in, dSdt_out, spec);
+            term->id = spec.id.empty() ? spec.kind : spec.id;
             sys.add(std::move(term));
         }
         return sys;
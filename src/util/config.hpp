@@ -1,10 +1,13 @@
 #pragma once
 
 #include "../core/system.hpp"
+#include "../io/codec.hpp"
+#include "../io/insitu.hpp"
 #include "toml.hpp"
 
 #include <array>
 #include <fstream>
+#include <map>
 #include <optional>
 #include <stdexcept>
 #include <string>
@@ -17,6 +20,11 @@ template <int D>
 struct GridCfg {
     std::array<int, D> n{};
     std::array<double, D> L{};
+    // y-z tile sizes of the 3D stencils (0 = no tiling), used if autotune_tiles is false. Autotuned
+    // sizes are stored in tile_cache (empty = default location)
+    bool autotune_tiles = true;
+    std::array<int, 2> tiles{};
+    std::string tile_cache;
 };
 
 struct TimeCfg {
@@ -27,15 +35,47 @@ struct TimeCfg {
 struct OutputCfg {
     bool output_append = false;
     std::string output_filename = "energy.dat";
+    // per-term energies and wall times, printed alongside the energy file (empty = disabled)
+    std::string terms_filename = "energy_terms.dat";
     int output_every;
-    int conf_every;
+    int conf_every;  // full configurations, 0 = never (only the final one is written)
     std::vector<std::string> mass_fields;
+    // configurations and checkpoints waiting to be written by the background thread (0 = write them
+    // synchronously). Each of them holds a copy of the state
+    int output_queue = 2;
+    // "plain" (one text file per field, 1D and 2D only) or "binary" (a single file with an index, see
+    // io/trajectory.hpp)
+    std::string trajectory_format = "plain";
+    std::string trajectory_filename = "trajectory.bin";  // binary only
+    // binary only: compression of the fields, which can be set field by field (see io/codec.hpp)
+    io::Compression trajectory_compression;
+    std::map<std::string, io::Compression> field_compression;
     bool print_vtk = false;
     std::string vtk_dir = "vtk";
+    // "ascii" (one file per field and step), "binary" (legacy, one file per step) or "vti" (XML, one
+    // file per step plus a .pvd index)
+    std::string vtk_format = "ascii";
+    int vtk_compression = 0;  // vti only: zlib level, 0 = uncompressed
+    // in-situ output (written to vtk_dir, see io/insitu.hpp): slices every slice_every steps and
+    // copies of the fields averaged over blocks of downsample^D points every downsample_every steps
+    std::vector<io::SliceSpec> slices;
+    int slice_every = 0;
+    int downsample = 0;  // 0 = no downsampled output
+    int downsample_every = 0;
+};
+
+struct CheckpointCfg {
+    int every = 0;  // write a checkpoint every this many steps (and at the end), 0 = never
+    std::string filename = "checkpoint.bin";
+    std::string restart;  // if not empty, the fields, the step and the RNG state are loaded from this file
 };
 
 struct IntegratorCfg {
     std::string name = "euler";
+    // euler only: number of steps advanced per tile before writing back (1 = no temporal blocking)
+    // and thickness of the tiles, in grid planes along the slowest axis
+    int time_block = 1;
+    int time_tile = 32;
 };
 
 struct FieldInitialisation {
@@ -64,6 +104,7 @@ struct GeneralConfig {
     GridCfg<D> grid{};
     TimeCfg time{};
     OutputCfg out{};
+    CheckpointCfg checkpoint{};
     IntegratorCfg integrator{};
     FieldsCfg fields{};
     BuildSysFn<D> build_system_fn;
@@ -1,6 +1,9 @@
 #pragma once
 
 #include <cstdint>
+#include <cstring>
+#include <memory>
+#include <type_traits>
 
 namespace circa {
 
@@ -24,6 +27,12 @@ inline bool safe_isnan(double val) noexcept {
     return (x & 0x7FFFFFFFFFFFFFFFu) >= 0x7FF0000000000001u;
 }
 
+// false for NaNs and infinities, which -ffast-math makes std::isfinite unable to detect
+inline bool safe_isfinite(double val) noexcept {
+    const auto x = cpp11_bit_cast<std::uint64_t>(val);
+    return (x & 0x7FF0000000000000u) != 0x7FF0000000000000u;
+}
+
 }
 
 } // namespace circa
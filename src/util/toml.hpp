@@ -30,6 +30,22 @@ std::array<T, N> array_from_toml(const toml::array& a, const char* key) {
     return out;
 }
 
+template <typename T, size_t N>
+std::array<std::array<T, N>, N> matrix_from_toml(const toml::array& a, const char* key) {
+    if (a.size() != N) {
+        throw std::runtime_error(fmt::format("Expected {} to have {} rows", key, N));
+    }
+    std::array<std::array<T, N>, N> out{};
+    for (size_t i = 0; i < N; ++i) {
+        auto row = a[i].as_array();
+        if (!row) {
+            throw std::runtime_error(fmt::format("Expected {} to be a matrix", key));
+        }
+        out[i] = array_from_toml<T, N>(*row, key);
+    }
+    return out;
+}
+
 template <class T>
 std::optional<T> value_or_die(const toml::table& tbl, std::string_view key_path) {
     // Resolve dotted path (e.g. "server.port")
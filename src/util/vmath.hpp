@@ -0,0 +1,191 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <type_traits>
+
+#include "math.hpp"
+
+namespace circa {
+
+namespace vmath {
+
+// EXACT: the standard library functions (which the compiler may still map onto its vector math library)
+// FAST: inlined, branch-free polynomial approximations that vectorise with the surrounding loop.
+//       Arguments must be finite, and positive and normal for log and pow. See bench/vmath.cpp for
+//       their accuracy and throughput.
+enum class Accuracy {
+    EXACT,
+    FAST
+};
+
+inline Accuracy accuracy_from_string(const std::string& s) {
+    if(s == "exact") {
+        return Accuracy::EXACT;
+    }
+    if(s == "fast") {
+        return Accuracy::FAST;
+    }
+    throw std::runtime_error("unknown math accuracy '" + s + "' (should be 'exact' or 'fast')");
+}
+
+namespace detail {
+
+constexpr double LOG2E = 1.4426950408889634074;
+constexpr double LN2_HI = 6.93147180369123816490e-01;
+constexpr double LN2_LO = 1.90821492927058770002e-10;
+constexpr double SQRT2 = 1.41421356237309504880;
+
+// exp(x) = 2^k exp(r), with |r| <= ln(2) / 2 and exp(r) approximated by its degree-13 Taylor polynomial
+inline double fast_exp(double x) {
+    x = std::min(std::max(x, -708.0), 709.0);
+    const double k = std::floor(x * LOG2E + 0.5);
+    const double r = (x - k * LN2_HI) - k * LN2_LO;
+
+    double p = 1.0 / 6227020800.0;
+    p = p * r + 1.0 / 479001600.0;
+    p = p * r + 1.0 / 39916800.0;
+    p = p * r + 1.0 / 3628800.0;
+    p = p * r + 1.0 / 362880.0;
+    p = p * r + 1.0 / 40320.0;
+    p = p * r + 1.0 / 5040.0;
+    p = p * r + 1.0 / 720.0;
+    p = p * r + 1.0 / 120.0;
+    p = p * r + 1.0 / 24.0;
+    p = p * r + 1.0 / 6.0;
+    p = p * r + 0.5;
+    p = p * r + 1.0;
+    p = p * r + 1.0;
+
+    const int64_t ki = (int32_t)k;
+    const double two_k = util::cpp11_bit_cast<double>((uint64_t)(ki + 1023) << 52);
+    return p * two_k;
+}
+
+// log(x) = e ln(2) + log(m), with m in [sqrt(1/2), sqrt(2)) and log(m) = 2 atanh((m - 1) / (m + 1))
+// approximated by its series truncated at the 19th power
+inline double fast_log(double x) {
+    const uint64_t bits = util::cpp11_bit_cast<uint64_t>(x);
+    const int32_t e_raw = (int32_t)(bits >> 52) - 1023;
+    double m = util::cpp11_bit_cast<double>((bits & 0x000FFFFFFFFFFFFFull) | 0x3FF0000000000000ull);
+
+    const bool big = m > SQRT2;
+    m = big ? 0.5 * m : m;
+    const double e = (double)(big ? e_raw + 1 : e_raw);
+
+    const double f = (m - 1.0) / (m + 1.0);
+    const double f2 = f * f;
+    double s = 1.0 / 19.0;
+    s = s * f2 + 1.0 / 17.0;
+    s = s * f2 + 1.0 / 15.0;
+    s = s * f2 + 1.0 / 13.0;
+    s = s * f2 + 1.0 / 11.0;
+    s = s * f2 + 1.0 / 9.0;
+    s = s * f2 + 1.0 / 7.0;
+    s = s * f2 + 1.0 / 5.0;
+    s = s * f2 + 1.0 / 3.0;
+    const double log_m = 2.0 * f + 2.0 * f * f2 * s;
+
+    return e * LN2_HI + (log_m + e * LN2_LO);
+}
+
+}  // namespace detail
+
+// scalar kernels, meant to be called from (vectorisable) loops
+template <Accuracy A>
+inline double exp(double x) {
+    if constexpr (A == Accuracy::FAST) {
+        return detail::fast_exp(x);
+    }
+    else {
+        return std::exp(x);
+    }
+}
+
+template <Accuracy A>
+inline double log(double x) {
+    if constexpr (A == Accuracy::FAST) {
+        return detail::fast_log(x);
+    }
+    else {
+        return std::log(x);
+    }
+}
+
+template <Accuracy A>
+inline double pow(double x, double y) {
+    if constexpr (A == Accuracy::FAST) {
+        return detail::fast_exp(y * detail::fast_log(x));
+    }
+    else {
+        return std::pow(x, y);
+    }
+}
+
+// x^n for a small non-negative integer n, which is both more accurate and much cheaper than pow
+inline double powi(double x, int n) {
+    double r = 1.0;
+    for(int i = 0; i < n; i++) {
+        r *= x;
+    }
+    return r;
+}
+
+// the hardware square root is already both exact and vectorisable
+template <Accuracy A>
+inline double sqrt(double x) {
+    return std::sqrt(x);
+}
+
+// Calls fn with a std::integral_constant holding the accuracy that matches acc, so that
+// the accuracy check is done once per array rather than once per element
+template <class F>
+inline void dispatch(Accuracy acc, F&& fn) {
+    if(acc == Accuracy::FAST) {
+        fn(std::integral_constant<Accuracy, Accuracy::FAST>{});
+    }
+    else {
+        fn(std::integral_constant<Accuracy, Accuracy::EXACT>{});
+    }
+}
+
+// array versions
+inline void exp(const double* in, double* out, int n, Accuracy acc) {
+    dispatch(acc, [&](auto A) {
+        for(int i = 0; i < n; i++) {
+            out[i] = exp<decltype(A)::value>(in[i]);
+        }
+    });
+}
+
+inline void log(const double* in, double* out, int n, Accuracy acc) {
+    dispatch(acc, [&](auto A) {
+        for(int i = 0; i < n; i++) {
+            out[i] = log<decltype(A)::value>(in[i]);
+        }
+    });
+}
+
+inline void pow(const double* in, double y, double* out, int n, Accuracy acc) {
+    dispatch(acc, [&](auto A) {
+        for(int i = 0; i < n; i++) {
+            out[i] = pow<decltype(A)::value>(in[i], y);
+        }
+    });
+}
+
+inline void sqrt(const double* in, double* out, int n, Accuracy acc) {
+    dispatch(acc, [&](auto A) {
+        for(int i = 0; i < n; i++) {
+            out[i] = sqrt<decltype(A)::value>(in[i]);
+        }
+    });
+}
+
+}  // namespace vmath
+
+}  // namespace circa